@@ -0,0 +1,629 @@
+import ctypes
+import itertools
+import os
+import platform
+
+import numpy as np
+import pandas as pd
+
+try:
+    from . import _tbag
+except ImportError:
+    _tbag = None
+
+# the native module exports the library symbols as well, so the streaming api loads it when it is built
+if _tbag is not None:
+    _lib = ctypes.CDLL(_tbag.__file__)
+else:
+    _LIB_NAME = 'trajectory_clustering.dll' if platform.system() == 'Windows' else 'trajectory_clustering.so'
+    _lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'lib', _LIB_NAME))
+
+_double_p = ctypes.POINTER(ctypes.c_double)
+_int_p = ctypes.POINTER(ctypes.c_int)
+_uint_p = ctypes.POINTER(ctypes.c_uint)
+_params = [ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_uint]
+
+_strides = [ctypes.c_ssize_t, ctypes.c_ssize_t]
+
+_STATS_HISTOGRAM_BUCKETS = 18
+
+_SUMMARY_DTYPE = np.dtype([('len', np.uintc), ('first_epoch', 'f8'), ('last_epoch', 'f8'), ('min_lat', 'f8'),
+                           ('max_lat', 'f8'), ('min_lon', 'f8'), ('max_lon', 'f8'), ('min_alt', 'f8'), ('max_alt', 'f8'),
+                           ('path_length', 'f8'), ('mean_speed', 'f8'), ('heading', 'f8'), ('heading_east', 'f8'),
+                           ('heading_north', 'f8')], align=True)
+
+_TRAJECTORY_FILE_HEADER_SIZE = 64
+_TRAJECTORY_FILE_ERRORS = {-1: OSError, -2: ValueError, -3: ValueError, -4: MemoryError}
+_TRAJECTORY_FILE_MESSAGES = {-1: 'could not open, create or map', -2: 'not a valid trajectory file',
+                             -3: 'points are not sorted by time ascending in', -4: 'out of memory clustering'}
+
+_CSV_LOADER_ERRORS = {-1: OSError, -2: ValueError, -3: ValueError, -4: MemoryError}
+_CSV_LOADER_MESSAGES = {-1: 'could not open or map', -2: 'columns %s are not all in the header line of',
+                        -3: 'could not parse line %d of', -4: 'out of memory reading'}
+
+
+class _Params(ctypes.Structure):
+    _fields_ = [('distance_threshold', ctypes.c_double),
+                ('time_threshold', ctypes.c_double),
+                ('angle_diff_threshold', ctypes.c_double),
+                ('speed_diff_threshold', ctypes.c_double),
+                ('window_size', ctypes.c_uint)]
+
+
+class _Stats(ctypes.Structure):
+    _fields_ = [('points', ctypes.c_uint64),
+                ('clusters_created', ctypes.c_uint64),
+                ('clusters_finished', ctypes.c_uint64),
+                ('candidates_histogram', ctypes.c_uint64 * _STATS_HISTOGRAM_BUCKETS),
+                ('compatibility_checks', ctypes.c_uint64),
+                ('compatible', ctypes.c_uint64),
+                ('pruned', ctypes.c_uint64),
+                ('rejected_distance', ctypes.c_uint64),
+                ('rejected_time', ctypes.c_uint64),
+                ('rejected_angle', ctypes.c_uint64),
+                ('rejected_speed', ctypes.c_uint64),
+                ('search_seconds', ctypes.c_double),
+                ('append_seconds', ctypes.c_double),
+                ('label_seconds', ctypes.c_double)]
+
+    def to_dict(self):
+        res = {name: getattr(self, name) for name, _ in self._fields_}
+        res['candidates_histogram'] = list(self.candidates_histogram)
+        return res
+
+
+_lib.agglomerative_clustering_strided.argtypes = [ctypes.c_void_p, _double_p, ctypes.c_uint] + _strides + _params + [_int_p]
+_lib.agglomerative_clustering_strided.restype = None
+
+_lib.agglomerative_clustering_sharded.argtypes = [_double_p, ctypes.c_uint] + _strides + [ctypes.c_uint] + _params + [
+    _int_p]
+_lib.agglomerative_clustering_sharded.restype = None
+
+_lib.agglomerative_clustering_unordered.argtypes = [ctypes.c_void_p, _double_p, ctypes.c_uint] + _strides + [
+    ctypes.c_double] + _params + [_int_p]
+_lib.agglomerative_clustering_unordered.restype = ctypes.c_uint
+
+_lib.agglomerative_clustering_scans.argtypes = [ctypes.c_void_p, _double_p, ctypes.c_uint] + _strides + _params + [_int_p]
+_lib.agglomerative_clustering_scans.restype = None
+
+_lib.agglomerative_clustering_tiled.argtypes = [_double_p, ctypes.c_uint] + _strides + [ctypes.c_double] + _params + [
+    ctypes.c_int, _int_p]
+_lib.agglomerative_clustering_tiled.restype = None
+
+_lib.agglomerative_clustering_batch.argtypes = [_double_p, ctypes.c_uint, _uint_p] + _strides + [
+    ctypes.POINTER(_Params), ctypes.c_int, _int_p]
+_lib.agglomerative_clustering_batch.restype = None
+
+_lib.agglomerative_clustering_sweep.argtypes = [_double_p, ctypes.c_uint] + _strides + [
+    ctypes.POINTER(_Params), ctypes.c_uint, ctypes.c_int, _int_p, _uint_p]
+_lib.agglomerative_clustering_sweep.restype = None
+
+_lib.merge_fragments.argtypes = [_double_p, ctypes.c_uint] + _strides + [ctypes.c_double, ctypes.c_double,
+                                                                        ctypes.c_double, ctypes.c_uint,
+                                                                        ctypes.c_double, _int_p]
+_lib.merge_fragments.restype = ctypes.c_uint
+
+_lib.agglomerative_clustering_file.argtypes = [ctypes.c_char_p, ctypes.c_char_p] + _params + [ctypes.c_int]
+_lib.agglomerative_clustering_file.restype = ctypes.c_int
+_lib.trajectory_file_write.argtypes = [ctypes.c_char_p, _double_p, ctypes.c_uint] + _strides
+_lib.trajectory_file_write.restype = ctypes.c_int
+
+_lib.csv_reader_open.argtypes = [ctypes.c_char_p] * 5 + [ctypes.c_int, _int_p]
+_lib.csv_reader_open.restype = ctypes.c_void_p
+_lib.csv_reader_rows.argtypes = [ctypes.c_void_p]
+_lib.csv_reader_rows.restype = ctypes.c_uint
+_lib.csv_reader_read.argtypes = [ctypes.c_void_p, _double_p] + _strides + [ctypes.c_uint8]
+_lib.csv_reader_read.restype = ctypes.c_int
+_lib.csv_reader_error_line.argtypes = [ctypes.c_void_p]
+_lib.csv_reader_error_line.restype = ctypes.c_size_t
+_lib.csv_reader_close.argtypes = [ctypes.c_void_p]
+_lib.csv_reader_close.restype = None
+
+_lib.clustering_set_summaries.argtypes = [ctypes.c_void_p, ctypes.c_uint8]
+_lib.clustering_set_summaries.restype = None
+_lib.clustering_set_motion_gate.argtypes = [ctypes.c_void_p, ctypes.c_double]
+_lib.clustering_set_motion_gate.restype = None
+_lib.clustering_summaries.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+_lib.clustering_summaries.restype = ctypes.c_uint
+_lib.summarize_clusters.argtypes = [_double_p, ctypes.c_uint] + _strides + [_int_p, ctypes.c_uint, ctypes.c_void_p]
+_lib.summarize_clusters.restype = None
+_lib.cluster_membership.argtypes = [_int_p, ctypes.c_uint, ctypes.c_uint, _uint_p, _uint_p]
+_lib.cluster_membership.restype = None
+
+_lib.clustering_init.argtypes = _params
+_lib.clustering_init.restype = ctypes.c_void_p
+_lib.clustering_set_threads.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.clustering_set_threads.restype = ctypes.c_int
+_lib.clustering_set_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(_Stats)]
+_lib.clustering_set_stats.restype = None
+_lib.clustering_push_strided.argtypes = [ctypes.c_void_p, _double_p, ctypes.c_uint] + _strides + [_int_p]
+_lib.clustering_push_strided.restype = None
+_lib.clustering_push_scans.argtypes = [ctypes.c_void_p, _double_p, ctypes.c_uint] + _strides + [_int_p]
+_lib.clustering_push_scans.restype = None
+_lib.clustering_flush.argtypes = [ctypes.c_void_p]
+_lib.clustering_flush.restype = None
+_lib.clustering_next_finished.argtypes = [ctypes.c_void_p, _uint_p]
+_lib.clustering_next_finished.restype = ctypes.c_int
+_lib.clustering_pop_finished.argtypes = [ctypes.c_void_p, _uint_p]
+_lib.clustering_pop_finished.restype = None
+_lib.clustering_destroy.argtypes = [ctypes.c_void_p]
+_lib.clustering_destroy.restype = None
+
+
+class TBAG:
+    """Trajectory Based Agglomerative Grouping.
+
+    eps: float - maximum distance between clusters
+    alpha: float - maximum angle difference between new point and last `window` points in cluster
+    time_eps: float - maximum time difference between clusters
+    speed_eps: float - maximum speed difference between new point and last `window` points in cluster
+    window: int - number of points in cluster to calculate the alpha on
+    n_jobs: int - number of threads evaluating the candidate clusters of a point, -1 for one per core,
+        the labels do not depend on it
+    n_shards: int - number of time shards `predict` clusters in parallel and stitches, 0 for one per core,
+        the labels are the ones of a single pass
+    stats: bool - collect run statistics into `stats_`, not collected for `n_shards` other than 1
+    merge_gap: float - maximum seconds between the end of a cluster and the start of a cluster `predict` joins to it
+        as a fragment of the same trajectory, None to keep the clusters of the pass
+    summaries: bool - summarize every cluster into `summaries_` while clustering
+    lateness: float - maximum seconds a point may arrive after a newer point, `predict` then takes points that are
+        only roughly sorted by time and labels the points that arrive later -1, None for time sorted points
+    motion_eps: float - maximum distance between a point and the position a cluster with two or more points predicts
+        for it from its velocity, `eps` then only gates the clusters of one point, None to gate every cluster at `eps`
+        of its last point. not used with `n_shards` other than 1
+    scans: bool - cluster the points that share a timestamp together as one scan, every cluster takes at most one point
+        of a scan and the closest pairs of the scan are joined first. `partial_fit` chunks should end between scans
+    tile_size: float - width in meters of the spatial tiles `predict` clusters in parallel on `n_jobs` threads, the
+        tiles whose points come within `eps` and `time_eps` of each other are clustered together so the labels are
+        the ones of a single pass, None for a single pass
+    """
+
+    def __init__(self, eps=200, alpha=10, time_eps=np.inf, speed_eps=300, window=4, n_jobs=1, n_shards=1, stats=False,
+                 merge_gap=None, summaries=False, lateness=None, motion_eps=None, scans=False,
+                 tile_size=None):
+        self.eps = eps
+        self.alpha = alpha
+        self.time_eps = time_eps
+        self.speed_eps = speed_eps
+        self.window = window
+        self.n_jobs = n_jobs
+        self.n_shards = n_shards
+        self.stats = stats
+        self.merge_gap = merge_gap
+        self.summaries = summaries
+        self.lateness = lateness
+        self.motion_eps = motion_eps
+        self.scans = scans
+        self.tile_size = tile_size
+        self.late_points_ = 0
+        self._labels = None
+        self._summaries = None
+        self._data = None
+        self._state = None
+        self._arena = None
+        self._state_stats = _Stats()
+        self._arena_stats = _Stats()
+        self._last_stats = None
+
+    def __del__(self):
+        self._destroy_state()
+
+        if self._arena is not None:
+            _lib.clustering_destroy(self._arena)
+            self._arena = None
+
+    def _params(self):
+        return float(self.eps), float(self.time_eps), float(self.alpha), float(self.speed_eps), int(self.window)
+
+    def _motion_threshold(self):
+        return float('nan') if self.motion_eps is None else float(self.motion_eps)
+
+    @staticmethod
+    def _to_points(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians, keep_float32=False):
+        # the library reads any float64 layout through its strides, so the points are only copied when they have to
+        # be converted, the native module reads float32 as well
+        if isinstance(data, pd.DataFrame):
+            points = data[[lat_col, lon_col, alt_col, timestamp_col]].to_numpy()
+        else:
+            points = np.asarray(data)
+
+        if points.dtype != np.float64 and not (keep_float32 and points.dtype == np.float32):
+            points = points.astype('float64')
+
+        if cast_to_radians:
+            points = points.copy()
+            points[:, :2] = np.deg2rad(points[:, :2])
+
+        if points.strides[0] % points.itemsize or points.strides[1] % points.itemsize:
+            points = np.ascontiguousarray(points)
+
+        return points
+
+    @staticmethod
+    def _layout(points):
+        return (points.ctypes.data_as(_double_p), len(points), points.strides[0] // points.itemsize,
+                points.strides[1] // points.itemsize)
+
+    def _init_state(self):
+        state = _lib.clustering_init(*self._params())
+        _lib.clustering_set_threads(state, int(self.n_jobs))
+        return state
+
+    def _attach_stats(self, state, stats):
+        # the state keeps a pointer to the struct, the model owns it
+        _lib.clustering_set_stats(state, ctypes.byref(stats) if self.stats else None)
+        self._last_stats = stats if self.stats else None
+
+    @property
+    def stats_(self):
+        """Statistics of the last `predict`, or of the whole stream for `partial_fit`, as a dict.
+
+        Empty unless the model was created with `stats=True`.
+        """
+        return {} if self._last_stats is None else self._last_stats.to_dict()
+
+    @property
+    def membership_(self):
+        """Points of every cluster of the last `predict` in compressed sparse row form, as a tuple of offsets and indices.
+
+        The points of cluster `i` are `indices[offsets[i]:offsets[i + 1]]` in the order they were given.
+        """
+        clusters = int(self._labels.max()) + 1 if len(self._labels) else 0
+        offsets = np.empty(clusters + 1, dtype=np.uintc)
+        indices = np.empty(len(self._labels), dtype=np.uintc)
+        _lib.cluster_membership(self._labels.ctypes.data_as(_int_p), len(self._labels), clusters,
+                                offsets.ctypes.data_as(_uint_p), indices.ctypes.data_as(_uint_p))
+        # the late points are in no cluster
+        return offsets, indices[:offsets[-1]]
+
+    @property
+    def summaries_(self):
+        """Summary of every cluster of the last `predict`, or of the stream for `partial_fit`, as a dataframe by id.
+
+        The columns are the number of points, first and last epoch, bounding box, path length in meters, mean speed in
+        m/s and the mean heading of the steps in degrees counterclockwise from east. Empty unless the model was created
+        with `summaries=True`.
+        """
+        summaries = None if self._summaries is None else self._summaries()
+
+        if summaries is None:
+            return self._summary_frame(np.empty(0, dtype=_SUMMARY_DTYPE))
+
+        return summaries
+
+    def _stream_summaries(self):
+        return None if self._state is None else self._read_summaries(self._state)
+
+    @staticmethod
+    def _summary_frame(summaries):
+        frame = pd.DataFrame(summaries)
+        return frame.drop(columns=['heading_east', 'heading_north'])
+
+    def _read_summaries(self, state):
+        summaries = np.empty(_lib.clustering_summaries(state, None), dtype=_SUMMARY_DTYPE)
+        _lib.clustering_summaries(state, summaries.ctypes.data)
+        return self._summary_frame(summaries)
+
+    def _summarize(self, data, res):
+        data = data if data.dtype == np.float64 else data.astype('float64')
+        clusters = int(res.max()) + 1 if len(res) else 0
+        summaries = np.empty(clusters, dtype=_SUMMARY_DTYPE)
+        _lib.summarize_clusters(*self._layout(data), res.ctypes.data_as(_int_p), clusters, summaries.ctypes.data)
+        return self._summary_frame(summaries)
+
+    def _destroy_state(self):
+        if self._state is not None:
+            _lib.clustering_destroy(self._state)
+            self._state = None
+
+    def fit(self, data, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+            cast_to_radians=False):
+        self._data = self._to_points(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians,
+                                     keep_float32=_tbag is not None)
+        return self
+
+    def predict(self):
+        if self.lateness is not None and (self.n_shards != 1 or self.merge_gap is not None):
+            raise ValueError('lateness can not be combined with n_shards or merge_gap, they need time sorted points')
+
+        if self.motion_eps is not None and self.n_shards != 1:
+            raise ValueError('motion_eps can not be combined with n_shards')
+
+        if self.scans and (self.n_shards != 1 or self.lateness is not None):
+            raise ValueError('scans can not be combined with n_shards or lateness')
+
+        if self.tile_size is not None and (self.n_shards != 1 or self.lateness is not None
+                                           or self.motion_eps is not None or self.scans):
+            raise ValueError('tile_size can not be combined with n_shards, lateness, motion_eps or scans')
+
+        self.late_points_ = 0
+        res = self._predict()
+        self._labels = res
+        self._summaries = None
+
+        if self.merge_gap is not None:
+            data = self._data if self._data.dtype == np.float64 else self._data.astype('float64')
+            _lib.merge_fragments(*self._layout(data), float(self.eps), float(self.alpha), float(self.speed_eps),
+                                 int(self.window), float(self.merge_gap), res.ctypes.data_as(_int_p))
+
+        if self.summaries:
+            # the merged and stitched clusters are not the clusters of the pass, so they are summarized from the labels
+            if self.merge_gap is not None or self.n_shards != 1 or self.tile_size is not None:
+                summaries = self._summarize(self._data, res)
+            else:
+                summaries = self._read_summaries(self._arena)
+
+            self._summaries = lambda: summaries
+
+        return res
+
+    def _predict(self):
+        # the native module clusters without the GIL and hands over its result buffer, statistics and shards
+        # go through the library
+        if (_tbag is not None and self.n_shards == 1 and not self.stats and not self.summaries
+                and self.lateness is None and self.motion_eps is None and not self.scans
+                and self.tile_size is None):
+            self._last_stats = None
+            return np.asarray(_tbag.fit_predict(self._data, *self._params(), int(self.n_jobs)))
+
+        data = self._data if self._data.dtype == np.float64 else self._data.astype('float64')
+        res = np.empty(len(data), dtype=np.intc)
+
+        if self.n_shards != 1:
+            self._last_stats = None
+            _lib.agglomerative_clustering_sharded(*self._layout(data), int(self.n_shards), *self._params(),
+                                                  res.ctypes.data_as(_int_p))
+            return res
+
+        if self.tile_size is not None:
+            self._last_stats = None
+            _lib.agglomerative_clustering_tiled(*self._layout(data), float(self.tile_size), *self._params(),
+                                                int(self.n_jobs), res.ctypes.data_as(_int_p))
+            return res
+
+        # the arena keeps the clustering storage between predictions
+        if self._arena is None:
+            self._arena = self._init_state()
+        else:
+            _lib.clustering_set_threads(self._arena, int(self.n_jobs))
+
+        self._attach_stats(self._arena, self._arena_stats)
+        _lib.clustering_set_summaries(self._arena, bool(self.summaries))
+        _lib.clustering_set_motion_gate(self._arena, self._motion_threshold())
+
+        if self.lateness is not None:
+            self.late_points_ = _lib.agglomerative_clustering_unordered(self._arena, *self._layout(data),
+                                                                        float(self.lateness), *self._params(),
+                                                                        res.ctypes.data_as(_int_p))
+            return res
+
+        if self.scans:
+            _lib.agglomerative_clustering_scans(self._arena, *self._layout(data), *self._params(),
+                                                res.ctypes.data_as(_int_p))
+            return res
+
+        _lib.agglomerative_clustering_strided(self._arena, *self._layout(data), *self._params(),
+                                              res.ctypes.data_as(_int_p))
+        return res
+
+    def fit_predict(self, data, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+                    cast_to_radians=False):
+        return self.fit(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians).predict()
+
+    def fit_predict_scenes(self, scenes, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+                           cast_to_radians=False, params=None):
+        """Cluster many independent scenes in one call, spread over `n_jobs` threads.
+
+        scenes: list of dataframes or arrays like in `fit`, each sorted by time ascending
+        params: optional list of dicts, one per scene, overriding the model parameters (eps, alpha, time_eps,
+            speed_eps, window) of that scene
+
+        Returns a list with the cluster ids of every scene, the ids of every scene start from 0.
+        """
+        points = [self._to_points(scene, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians)
+                  for scene in scenes]
+
+        if not points:
+            return []
+
+        offsets = np.zeros(len(points) + 1, dtype=np.uintc)
+        np.cumsum([len(scene) for scene in points], out=offsets[1:])
+        data = np.ascontiguousarray(np.concatenate(points))
+        scene_params = (_Params * len(points))()
+        defaults = dict(eps=self.eps, time_eps=self.time_eps, alpha=self.alpha, speed_eps=self.speed_eps,
+                        window=self.window)
+
+        for i in range(len(points)):
+            scene = defaults if params is None else {**defaults, **params[i]}
+            scene_params[i] = _Params(float(scene['eps']), float(scene['time_eps']), float(scene['alpha']),
+                                      float(scene['speed_eps']), int(scene['window']))
+
+        res = np.empty(len(data), dtype=np.intc)
+        _lib.agglomerative_clustering_batch(data.ctypes.data_as(_double_p), len(points),
+                                            offsets.ctypes.data_as(_uint_p), data.shape[1], 1, scene_params,
+                                            int(self.n_jobs), res.ctypes.data_as(_int_p))
+        return np.split(res, offsets[1:-1].astype(np.intp))
+
+    def sweep(self, data, grid, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+              cast_to_radians=False):
+        """Cluster the same data with every combination of a parameter grid in one call, spread over `n_jobs` threads.
+
+        data: dataframe or array like in `fit`, sorted by time ascending
+        grid: dict from parameter name (eps, alpha, time_eps, speed_eps, window) to the list of its values, the
+            parameters that are not in it keep the model value
+
+        Returns the labels as an array of one row per combination and a dataframe of the combinations with the number
+        of clusters of each.
+        """
+        names = ['eps', 'time_eps', 'alpha', 'speed_eps', 'window']
+        unknown = set(grid) - set(names)
+
+        if unknown:
+            raise ValueError('unknown sweep parameters %s' % sorted(unknown))
+
+        points = self._to_points(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians)
+        values = [list(grid.get(name, [getattr(self, name)])) for name in names]
+        configs = pd.DataFrame(list(itertools.product(*values)), columns=names)
+        sweep_params = (_Params * max(len(configs), 1))()
+
+        for i, config in enumerate(configs.itertuples(index=False)):
+            sweep_params[i] = _Params(float(config.eps), float(config.time_eps), float(config.alpha),
+                                      float(config.speed_eps), int(config.window))
+
+        res = np.empty((len(configs), len(points)), dtype=np.intc)
+        clusters = np.zeros(len(configs), dtype=np.uintc)
+        _lib.agglomerative_clustering_sweep(*self._layout(points), sweep_params, len(configs), int(self.n_jobs),
+                                            res.ctypes.data_as(_int_p), clusters.ctypes.data_as(_uint_p))
+        configs['clusters'] = clusters
+        return res, configs
+
+    @staticmethod
+    def write_trajectory_file(path, data, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+                              cast_to_radians=False):
+        """Write points to a trajectory file for `fit_predict_file`, the data is given like in `fit`."""
+        points = TBAG._to_points(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians)
+        TBAG._check_file_error(_lib.trajectory_file_write(os.fsencode(path), *TBAG._layout(points)), path)
+
+    @staticmethod
+    def read_csv(paths, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp', cast_to_radians=False,
+                 n_jobs=-1, sort=True):
+        """Read the points of track csv files in parallel chunks, straight into the layout `fit` takes.
+
+        paths: csv file or list of csv files with a header line, their points are concatenated
+        timestamp_col: column of ISO 8601 timestamps, UTC unless they have an offset, or of seconds since the epoch
+        n_jobs: number of threads parsing every file, -1 for one per core
+        sort: sort the points by time, stable so equal times keep the order of the files
+
+        Returns the points as a float64 array of lat, lon, alt and epoch rows.
+        """
+        paths = [paths] if isinstance(paths, (str, bytes, os.PathLike)) else list(paths)
+        names = [name.encode() for name in (lat_col, lon_col, alt_col, timestamp_col)]
+        parts = []
+
+        for path in paths:
+            error = ctypes.c_int()
+            reader = _lib.csv_reader_open(os.fsencode(path), *names, int(n_jobs), ctypes.byref(error))
+
+            if reader is None:
+                TBAG._check_csv_error(error.value, path, ([lat_col, lon_col, alt_col, timestamp_col],))
+
+            try:
+                points = np.empty((_lib.csv_reader_rows(reader), 4))
+                data, _, row_stride, col_stride = TBAG._layout(points)
+                error = _lib.csv_reader_read(reader, data, row_stride, col_stride, bool(cast_to_radians))
+                TBAG._check_csv_error(error, path, _lib.csv_reader_error_line(reader))
+            finally:
+                _lib.csv_reader_close(reader)
+
+            parts.append(points)
+
+        points = parts[0] if len(parts) == 1 else np.concatenate(parts) if parts else np.empty((0, 4))
+
+        if sort and (np.diff(points[:, 3]) < 0).any():
+            points = points[np.argsort(points[:, 3], kind='stable')]
+
+        return points
+
+    def fit_predict_file(self, path, labels_path):
+        """Cluster a trajectory file without reading it into memory.
+
+        path: trajectory file written by `write_trajectory_file`
+        labels_path: labels file to create or overwrite
+
+        Returns the labels as a `np.memmap` of the labels file.
+        """
+        error = _lib.agglomerative_clustering_file(os.fsencode(path), os.fsencode(labels_path), *self._params(),
+                                                   int(self.n_jobs))
+        self._check_file_error(error, path)
+        self._last_stats = None
+
+        if os.path.getsize(labels_path) == 0:
+            return np.empty(0, dtype=np.intc)
+
+        res = np.memmap(labels_path, dtype=np.intc, mode='r+')
+
+        if self.merge_gap is not None:
+            data = self._map_trajectory_file(path)
+            _lib.merge_fragments(*self._layout(data), float(self.eps), float(self.alpha), float(self.speed_eps),
+                                 int(self.window), float(self.merge_gap), res.ctypes.data_as(_int_p))
+            res.flush()
+
+        return res
+
+    @staticmethod
+    def _map_trajectory_file(path):
+        # the columns are read through their strides straight from the mapped file when they are evenly spaced
+        header = np.fromfile(path, dtype='<u8', count=_TRAJECTORY_FILE_HEADER_SIZE // 8)
+        points, offsets = int(header[2]), header[3:7].astype(np.int64)
+        raw = np.memmap(path, dtype=np.uint8, mode='r')
+        columns = [raw[offset:offset + 8 * points].view('<f8') for offset in offsets]
+        spacing = np.diff(offsets)
+
+        if (spacing == spacing[0]).all() and spacing[0] > 0:
+            return np.lib.stride_tricks.as_strided(columns[0], shape=(points, 4), strides=(8, int(spacing[0])),
+                                                   writeable=False)
+
+        return np.column_stack(columns)
+
+    @staticmethod
+    def _check_csv_error(error, path, detail):
+        if error != 0:
+            message = _CSV_LOADER_MESSAGES[error]
+            message = message % detail if '%' in message else message
+            raise _CSV_LOADER_ERRORS[error]('%s %s' % (message, path))
+
+    @staticmethod
+    def _check_file_error(error, path):
+        if error != 0:
+            raise _TRAJECTORY_FILE_ERRORS[error]('%s %s' % (_TRAJECTORY_FILE_MESSAGES[error], path))
+
+    def partial_fit(self, data, lat_col='lat', lon_col='lon', alt_col='alt', timestamp_col='timestamp',
+                    cast_to_radians=False):
+        """Cluster the next chunk of an epoch sorted stream, keeping the open clusters between calls.
+
+        Returns the cluster ids of the chunk points, clusters that can no longer accept points
+        are collected with `pop_finished`.
+        """
+        if self._state is None:
+            self._state = self._init_state()
+            self._attach_stats(self._state, self._state_stats)
+            _lib.clustering_set_summaries(self._state, bool(self.summaries))
+            _lib.clustering_set_motion_gate(self._state, self._motion_threshold())
+        elif self.stats:
+            self._last_stats = self._state_stats
+
+        if self.summaries:
+            self._summaries = self._stream_summaries
+
+        points = self._to_points(data, lat_col, lon_col, alt_col, timestamp_col, cast_to_radians)
+        res = np.empty(len(points), dtype=np.intc)
+        push = _lib.clustering_push_scans if self.scans else _lib.clustering_push_strided
+        push(self._state, *self._layout(points), res.ctypes.data_as(_int_p))
+        return res
+
+    def flush(self):
+        """Close every open cluster of the stream so they are returned by `pop_finished`."""
+        if self._state is not None:
+            _lib.clustering_flush(self._state)
+
+    def pop_finished(self):
+        """Return a dict of cluster id to the stream indices of the clusters that were finished since the last call."""
+        finished = {}
+
+        if self._state is None:
+            return finished
+
+        length = ctypes.c_uint()
+        cluster_id = _lib.clustering_next_finished(self._state, ctypes.byref(length))
+
+        while cluster_id != -1:
+            indices = np.empty(length.value, dtype=np.uintc)
+            _lib.clustering_pop_finished(self._state, indices.ctypes.data_as(_uint_p))
+            finished[cluster_id] = indices
+            cluster_id = _lib.clustering_next_finished(self._state, ctypes.byref(length))
+
+        return finished
+
+    def reset(self):
+        """Drop the stream state so the next `partial_fit` starts a new stream."""
+        self._destroy_state()
@@ -0,0 +1 @@
+from .TrajectoryClustering import TBAG
@@ -0,0 +1,236 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <limits.h>
+
+#include "agglomerative.h"
+
+/// labels of a clustering run, exports the C result buffer through the buffer
+/// protocol so `numpy.asarray` wraps it without a copy and keeps it alive
+typedef struct labels_s {
+  PyObject_HEAD
+  int* labels;
+  Py_ssize_t len;
+  Py_ssize_t stride;
+} labels_t;
+
+static void labels_dealloc(labels_t* self) {
+  free(self->labels);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int labels_getbuffer(labels_t* self, Py_buffer* view, int flags) {
+  view->obj = (PyObject*)self;
+  Py_INCREF(self);
+  view->buf = self->labels;
+  view->len = self->len * (Py_ssize_t)sizeof(int);
+  view->readonly = 0;
+  view->itemsize = sizeof(int);
+  view->format = (flags & PyBUF_FORMAT) ? "i" : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? &self->len : NULL;
+  view->strides = (flags & PyBUF_STRIDES) ? &self->stride : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+
+  return 0;
+}
+
+static Py_ssize_t labels_length(labels_t* self) { return self->len; }
+
+static PyBufferProcs labels_buffer = {(getbufferproc)labels_getbuffer, NULL};
+
+static PySequenceMethods labels_sequence = {(lenfunc)labels_length};
+
+static PyTypeObject labels_type = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "TBAG._tbag.Labels",
+    .tp_basicsize = sizeof(labels_t),
+    .tp_dealloc = (destructor)labels_dealloc,
+    .tp_as_sequence = &labels_sequence,
+    .tp_as_buffer = &labels_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Cluster ids of the points, owns the C result buffer",
+};
+
+/// @brief cluster float32 rows, every point is widened on the fly so the
+/// array is never copied
+static void push_float_rows(clustering_state_t* state, char* data,
+                            unsigned int count, Py_ssize_t row_stride,
+                            Py_ssize_t col_stride, int* res) {
+  double point[WIDTH];
+
+  for (unsigned int i = 0; i < count; i++) {
+    char* row = data + (Py_ssize_t)i * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = *(float*)(row + (Py_ssize_t)j * col_stride);
+    }
+
+    res[i] = clustering_push_point(state, point);
+  }
+}
+
+/// @brief get the element type of a buffer format
+/// @return 'd', 'f' or 0 for an unsupported format
+static char point_format(const char* format) {
+  if (format == NULL) {
+    return 0;
+  }
+
+  // native and little endian formats are the same on every supported target
+  if (*format == '@' || *format == '=' || *format == '<') {
+    format++;
+  }
+
+  if ((*format == 'd' || *format == 'f') && format[1] == '\0') {
+    return *format;
+  }
+
+  return 0;
+}
+
+static PyObject* fit_predict(PyObject* self, PyObject* args,
+                             PyObject* kwargs) {
+  static char* keywords[] = {"points",    "eps",    "time_eps", "alpha",
+                             "speed_eps", "window", "n_jobs",   NULL};
+  PyObject* points;
+  double distance_threshold;
+  double time_threshold;
+  double angle_diff_threshold;
+  double speed_diff_threshold;
+  unsigned int window_size;
+  int threads = 1;
+  Py_buffer view;
+
+  (void)self;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OddddI|i", keywords,
+                                   &points, &distance_threshold,
+                                   &time_threshold, &angle_diff_threshold,
+                                   &speed_diff_threshold, &window_size,
+                                   &threads)) {
+    return NULL;
+  }
+
+  if (PyObject_GetBuffer(points, &view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+    return NULL;
+  }
+
+  char format = point_format(view.format);
+
+  if (view.ndim != 2 || view.shape[1] != WIDTH || format == 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError,
+                    "points must be a (n, 4) float64 or float32 array");
+    return NULL;
+  }
+
+  if (view.shape[0] > UINT_MAX) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_OverflowError, "too many points");
+    return NULL;
+  }
+
+  labels_t* labels = PyObject_New(labels_t, &labels_type);
+
+  if (labels == NULL) {
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  unsigned int height = (unsigned int)view.shape[0];
+  labels->len = height;
+  labels->stride = sizeof(int);
+  labels->labels = (int*)malloc(sizeof(int) * (height > 0 ? height : 1));
+
+  clustering_state_t* state =
+      labels->labels == NULL
+          ? NULL
+          : clustering_init(distance_threshold, time_threshold,
+                            angle_diff_threshold, speed_diff_threshold,
+                            window_size);
+
+  if (state == NULL) {
+    PyBuffer_Release(&view);
+    Py_DECREF(labels);
+    return PyErr_NoMemory();
+  }
+
+  Py_ssize_t row_stride = view.strides[0];
+  Py_ssize_t col_stride = view.strides[1];
+
+  // the buffer stays exported while the lock is released, so its memory can
+  // not go away under the clustering
+  Py_BEGIN_ALLOW_THREADS;
+
+  clustering_set_threads(state, threads);
+  state->emit_finished = FALSE;
+
+  if (format == 'd' && row_stride % (Py_ssize_t)sizeof(double) == 0 &&
+      col_stride % (Py_ssize_t)sizeof(double) == 0) {
+    clustering_push_strided(state, (double*)view.buf, height,
+                            row_stride / (Py_ssize_t)sizeof(double),
+                            col_stride / (Py_ssize_t)sizeof(double),
+                            labels->labels);
+  } else if (format == 'd') {
+    // unaligned strides are read point by point
+    double point[WIDTH];
+
+    for (unsigned int i = 0; i < height; i++) {
+      char* row = (char*)view.buf + (Py_ssize_t)i * row_stride;
+
+      for (unsigned int j = 0; j < WIDTH; j++) {
+        memcpy(&point[j], row + (Py_ssize_t)j * col_stride, sizeof(double));
+      }
+
+      labels->labels[i] = clustering_push_point(state, point);
+    }
+  } else {
+    push_float_rows(state, (char*)view.buf, height, row_stride, col_stride,
+                    labels->labels);
+  }
+
+  clustering_flush(state);
+  clustering_destroy(state);
+
+  Py_END_ALLOW_THREADS;
+
+  PyBuffer_Release(&view);
+
+  return (PyObject*)labels;
+}
+
+static PyMethodDef methods[] = {
+    {"fit_predict", (PyCFunction)(void (*)(void))fit_predict,
+     METH_VARARGS | METH_KEYWORDS,
+     "fit_predict(points, eps, time_eps, alpha, speed_eps, window, n_jobs=1)\n"
+     "--\n\n"
+     "Cluster an epoch sorted (n, 4) float64 or float32 array of LAT, LON, "
+     "ALT, EPOCH rows in any layout without copying it. The GIL is released "
+     "while clustering. Returns a Labels buffer owning the cluster ids, wrap "
+     "it with numpy.asarray."},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef module = {PyModuleDef_HEAD_INIT, "_tbag",
+                                    "Native TBAG clustering", -1, methods};
+
+PyMODINIT_FUNC PyInit__tbag(void) {
+  if (PyType_Ready(&labels_type) < 0) {
+    return NULL;
+  }
+
+  PyObject* res = PyModule_Create(&module);
+
+  if (res == NULL) {
+    return NULL;
+  }
+
+  Py_INCREF(&labels_type);
+
+  if (PyModule_AddObject(res, "Labels", (PyObject*)&labels_type) < 0) {
+    Py_DECREF(&labels_type);
+    Py_DECREF(res);
+    return NULL;
+  }
+
+  return res;
+}
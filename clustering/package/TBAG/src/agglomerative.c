@@ -5,24 +5,745 @@ void agglomerative_clustering(double **data, unsigned int height,
                               double angle_diff_threshold,
                               double speed_diff_threshold,
                               unsigned int window_size, int *res) {
-  cluster_t *clusters_array = (cluster_t *)malloc(0);
-  unsigned int cluster_len = 0;
+  clustering_state_t *state =
+      clustering_init(distance_threshold, time_threshold, angle_diff_threshold,
+                      speed_diff_threshold, window_size);
 
-  for (unsigned int i = 0; i < height; i++) {
-    int cluster_loc = find_closest_compatible_cluster(
-        data, height, clusters_array, cluster_len, i, distance_threshold,
+  agglomerative_clustering_with_arena(state, data, height, distance_threshold,
+                                      time_threshold, angle_diff_threshold,
+                                      speed_diff_threshold, window_size, res);
+  clustering_destroy(state);
+}
+
+void agglomerative_clustering_with_arena(
+    clustering_state_t *arena, double **data, unsigned int height,
+    double distance_threshold, double time_threshold,
+    double angle_diff_threshold, double speed_diff_threshold,
+    unsigned int window_size, int *res) {
+  clustering_reset(arena, distance_threshold, time_threshold,
+                   angle_diff_threshold, speed_diff_threshold, window_size);
+
+  // the labels are written as the points are pushed so the cluster members are
+  // not kept and closed clusters are released right away
+  arena->emit_finished = FALSE;
+
+  clustering_push_points(arena, data, height, res);
+  clustering_flush(arena);
+}
+
+void agglomerative_clustering_strided(
+    clustering_state_t *arena, double *data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int *res) {
+  clustering_state_t *state = arena;
+
+  if (state == NULL) {
+    state = clustering_init(distance_threshold, time_threshold,
+                            angle_diff_threshold, speed_diff_threshold,
+                            window_size);
+  } else {
+    clustering_reset(state, distance_threshold, time_threshold,
+                     angle_diff_threshold, speed_diff_threshold, window_size);
+  }
+
+  state->emit_finished = FALSE;
+
+  clustering_push_strided(state, data, height, row_stride, col_stride, res);
+  clustering_flush(state);
+
+  if (arena == NULL) {
+    clustering_destroy(state);
+  }
+}
+
+void agglomerative_clustering_sharded(
+    double *data, unsigned int height, ptrdiff_t row_stride,
+    ptrdiff_t col_stride, unsigned int shards, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int *res) {
+#ifdef _OPENMP
+  if (shards == 0) {
+    shards = (unsigned int)omp_get_max_threads();
+  }
+#endif
+
+  if (shards > height) {
+    shards = height;
+  }
+
+  if (shards <= 1) {
+    agglomerative_clustering_strided(
+        NULL, data, height, row_stride, col_stride, distance_threshold,
         time_threshold, angle_diff_threshold, speed_diff_threshold,
-        window_size);
-    if (cluster_loc != -1) {
-      add_to_cluster(clusters_array, (unsigned int)cluster_loc, i);
-    } else {
-      add_new_cluster(&clusters_array, &cluster_len, i);
+        window_size, res);
+    return;
+  }
+
+  clustering_state_t **states =
+      (clustering_state_t **)malloc(sizeof(clustering_state_t *) * shards);
+  unsigned int *bounds =
+      (unsigned int *)malloc(sizeof(unsigned int) * (shards + 1));
+  unsigned int *open = (unsigned int *)malloc(sizeof(unsigned int) * height);
+
+  for (unsigned int i = 0; i <= shards; i++) {
+    bounds[i] = (unsigned int)((size_t)height * i / shards);
+  }
+
+  // the open clusters are kept after the last point for the stitching, so
+  // the shards are not flushed
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (int i = 0; i < (int)shards; i++) {
+    states[i] =
+        clustering_init(distance_threshold, time_threshold,
+                        angle_diff_threshold, speed_diff_threshold,
+                        window_size);
+    states[i]->emit_finished = FALSE;
+
+    // the stitching compares the replay to the open clusters of the shard
+    // after every point
+    for (unsigned int j = bounds[i]; j < bounds[i + 1]; j++) {
+      clustering_push_strided(states[i], data + (ptrdiff_t)j * row_stride, 1,
+                              row_stride, col_stride, res + j);
+      open[j] = states[i]->active_len;
+    }
+  }
+
+  // the state that went through every point so far and the global id of each
+  // of its cluster ids, the global ids are given in the order the clusters
+  // first appear, like the ids of a single pass
+  clustering_state_t *exact = states[0];
+  unsigned int ids_len = (unsigned int)exact->next_cluster_id;
+  int *ids = (int *)malloc(sizeof(int) * (ids_len + 1));
+  int next_label = 0;
+
+  for (unsigned int i = 0; i < ids_len; i++) {
+    ids[i] = -1;
+  }
+
+  for (unsigned int j = bounds[0]; j < bounds[1]; j++) {
+    if (ids[res[j]] == -1) {
+      ids[res[j]] = next_label++;
+    }
+
+    res[j] = ids[res[j]];
+  }
+
+  for (unsigned int i = 1; i < shards; i++) {
+    clustering_state_t *shard = states[i];
+    unsigned int count = bounds[i + 1] - bounds[i];
+    int *shard_res = res + bounds[i];
+    int *continued =
+        (int *)malloc(sizeof(int) * (shard->next_cluster_id + 1));
+    unsigned int replayed =
+        stitch_shard(exact, shard, data + (ptrdiff_t)bounds[i] * row_stride,
+                     count, row_stride, col_stride, open + bounds[i],
+                     shard_res, continued);
+
+    ids = (int *)realloc(ids, sizeof(int) * (exact->next_cluster_id + 1));
+
+    for (; ids_len < (unsigned int)exact->next_cluster_id; ids_len++) {
+      ids[ids_len] = -1;
+    }
+
+    for (unsigned int j = 0; j < replayed; j++) {
+      if (ids[shard_res[j]] == -1) {
+        ids[shard_res[j]] = next_label++;
+      }
+
+      shard_res[j] = ids[shard_res[j]];
+    }
+
+    if (replayed == count) {
+      free(continued);
+      clustering_destroy(shard);
+      continue;
     }
+
+    // the shard state has the open clusters of a single pass from here on,
+    // its clusters that are open continue clusters of the replay
+    for (int j = 0; j < shard->next_cluster_id; j++) {
+      continued[j] = continued[j] != -1 ? ids[continued[j]] : -1;
+    }
+
+    for (unsigned int j = replayed; j < count; j++) {
+      if (continued[shard_res[j]] == -1) {
+        continued[shard_res[j]] = next_label++;
+      }
+
+      shard_res[j] = continued[shard_res[j]];
+    }
+
+    clustering_destroy(exact);
+    free(ids);
+    exact = shard;
+    ids = continued;
+    ids_len = (unsigned int)shard->next_cluster_id;
+  }
+
+  clustering_destroy(exact);
+  free(ids);
+  free(open);
+  free(bounds);
+  free(states);
+}
+
+void agglomerative_clustering_batch(double *data, unsigned int scenes,
+                                    unsigned int *offsets,
+                                    ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                    clustering_params_t *params, int threads,
+                                    int *res) {
+  if (scenes == 0) {
+    return;
+  }
+
+  scene_order_t *order =
+      (scene_order_t *)malloc(sizeof(scene_order_t) * scenes);
+
+  for (unsigned int i = 0; i < scenes; i++) {
+    order[i].len = offsets[i + 1] - offsets[i];
+    order[i].scene = i;
+  }
+
+  qsort(order, scenes, sizeof(scene_order_t), compare_scene_order);
+
+#ifdef _OPENMP
+  if (threads <= 0) {
+    threads = omp_get_max_threads();
+  }
+#else
+  (void)threads;
+#endif
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    // the clusters storage of a thread grows to its largest scene once and is
+    // reset for every other scene
+    clustering_state_t *arena = clustering_init(
+        params[0].distance_threshold, params[0].time_threshold,
+        params[0].angle_diff_threshold, params[0].speed_diff_threshold,
+        params[0].window_size);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int i = 0; i < (int)scenes; i++) {
+      unsigned int scene = order[i].scene;
+      clustering_params_t *scene_params = &params[scene];
+
+      agglomerative_clustering_strided(
+          arena, data + (ptrdiff_t)offsets[scene] * row_stride, order[i].len,
+          row_stride, col_stride, scene_params->distance_threshold,
+          scene_params->time_threshold, scene_params->angle_diff_threshold,
+          scene_params->speed_diff_threshold, scene_params->window_size,
+          res + offsets[scene]);
+    }
+
+    clustering_destroy(arena);
+  }
+
+  free(order);
+}
+
+void agglomerative_clustering_sweep(double *data, unsigned int height,
+                                    ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                    clustering_params_t *params,
+                                    unsigned int count, int threads, int *res,
+                                    unsigned int *clusters) {
+  if (count == 0) {
+    return;
+  }
+
+#ifdef _OPENMP
+  if (threads <= 0) {
+    threads = omp_get_max_threads();
+  }
+#else
+  (void)threads;
+#endif
+
+  size_t len = height > 0 ? height : 1;
+  double(*points)[WIDTH] =
+      (double(*)[WIDTH])malloc(sizeof(double[WIDTH]) * len);
+  double(*units)[3] = (double(*)[3])malloc(sizeof(double[3]) * len);
+
+  // every parameter set reads the same contiguous points and unit vectors
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads)
+#endif
+  for (int i = 0; i < (int)height; i++) {
+    double *row = data + (ptrdiff_t)i * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      points[i][j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    ecef_unit(points[i], units[i]);
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    clustering_state_t *arena = clustering_init(
+        params[0].distance_threshold, params[0].time_threshold,
+        params[0].angle_diff_threshold, params[0].speed_diff_threshold,
+        params[0].window_size);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int i = 0; i < (int)count; i++) {
+      int *labels = res + (size_t)i * height;
+
+      clustering_reset(arena, params[i].distance_threshold,
+                       params[i].time_threshold,
+                       params[i].angle_diff_threshold,
+                       params[i].speed_diff_threshold, params[i].window_size);
+      arena->emit_finished = FALSE;
+
+      for (unsigned int j = 0; j < height; j++) {
+        labels[j] = clustering_push_projected(arena, points[j], units[j], j);
+      }
+
+      clustering_flush(arena);
+      clusters[i] = (unsigned int)arena->next_cluster_id;
+    }
+
+    clustering_destroy(arena);
+  }
+
+  free(units);
+  free(points);
+}
+
+int compare_scene_order(const void *first, const void *second) {
+  const scene_order_t *first_scene = (const scene_order_t *)first;
+  const scene_order_t *second_scene = (const scene_order_t *)second;
+
+  if (first_scene->len != second_scene->len) {
+    return first_scene->len < second_scene->len ? 1 : -1;
+  }
+
+  return (first_scene->scene > second_scene->scene) -
+         (first_scene->scene < second_scene->scene);
+}
+
+unsigned int stitch_shard(clustering_state_t *exact, clustering_state_t *shard,
+                          double *data, unsigned int count,
+                          ptrdiff_t row_stride, ptrdiff_t col_stride,
+                          unsigned int *open, int *res, int *continued) {
+  // the replay creates one cluster per point at most
+  unsigned int exact_len = (unsigned int)exact->next_cluster_id + count;
+  int *pair = (int *)malloc(sizeof(int) * exact_len);
+  unsigned int *shared =
+      (unsigned int *)calloc(exact_len, sizeof(unsigned int));
+  unsigned int *len =
+      (unsigned int *)calloc((size_t)shard->next_cluster_id + 1,
+                             sizeof(unsigned int));
+  unsigned int next_check = 0;
+  unsigned int i = 0;
+
+  for (unsigned int j = 0; j < exact_len; j++) {
+    pair[j] = -1;
+  }
+
+  for (int j = 0; j < shard->next_cluster_id; j++) {
+    continued[j] = -1;
+  }
+
+  while (i < count) {
+    int id = res[i];
+    int exact_id;
+
+    clustering_push_strided(exact, data + (ptrdiff_t)i * row_stride, 1,
+                            row_stride, col_stride, &exact_id);
+    res[i++] = exact_id;
+
+    // a point that goes to other clusters in the two states splits them from
+    // the clusters they were paired with
+    if (pair[exact_id] != id || continued[id] != exact_id) {
+      if (pair[exact_id] != -1 && continued[pair[exact_id]] == exact_id) {
+        continued[pair[exact_id]] = -1;
+      }
+
+      if (continued[id] != -1 && pair[continued[id]] == id) {
+        pair[continued[id]] = -1;
+      }
+
+      pair[exact_id] = id;
+      continued[id] = exact_id;
+      shared[exact_id] = 0;
+    }
+
+    shared[exact_id]++;
+    len[id]++;
+
+    // paired clusters retire together, so the states have the same open
+    // clusters when as many are open and every open one of the replay is
+    // paired. the check walks the open clusters, so it is spaced out by as
+    // many points
+    if (i >= next_check && exact->active_len == open[i - 1]) {
+      if (shard_caught_up(exact, pair, continued, shared, len)) {
+        break;
+      }
+
+      next_check = i + exact->active_len;
+    }
+  }
+
+  free(len);
+  free(shared);
+  free(pair);
+
+  return i;
+}
+
+uint8_t shard_caught_up(clustering_state_t *exact, int *pair, int *continued,
+                        unsigned int *shared, unsigned int *len) {
+  for (int i = exact->oldest; i != -1; i = exact->clusters[i].newer) {
+    cluster_t *cluster = &exact->clusters[i];
+    int id = pair[cluster->id];
+
+    if (id == -1 || continued[id] != cluster->id) {
+      return FALSE;
+    }
+
+    // the tails are the same once they share a full tail, or when the two
+    // clusters are made of the same points
+    if (shared[cluster->id] < exact->tail_capacity &&
+        !(shared[cluster->id] == cluster->len &&
+          shared[cluster->id] == len[id])) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+int find_root(int *parent, int id) {
+  while (parent[id] != id) {
+    parent[id] = parent[parent[id]];
+    id = parent[id];
+  }
+
+  return id;
+}
+
+clustering_state_t *clustering_init(double distance_threshold,
+                                    double time_threshold,
+                                    double angle_diff_threshold,
+                                    double speed_diff_threshold,
+                                    unsigned int window_size) {
+  clustering_state_t *state =
+      (clustering_state_t *)calloc(1, sizeof(clustering_state_t));
+
+  if (state == NULL) {
+    return NULL;
+  }
+
+  // the kernel is selected by the reset, once the gates are known
+  state->kernel_isa = KERNEL_AUTO;
+  state->threads = 1;
+  clustering_reset(state, distance_threshold, time_threshold,
+                   angle_diff_threshold, speed_diff_threshold, window_size);
+
+  return state;
+}
+
+int clustering_set_kernel(clustering_state_t *state, int isa) {
+  state->kernel = select_compatibility_kernel(
+      isa, kernel_gates(state->time_threshold, state->speed_diff_threshold),
+      &state->kernel_isa);
+
+  return state->kernel_isa;
+}
+
+void clustering_set_stats(clustering_state_t *state,
+                          clustering_stats_t *stats) {
+  state->stats = stats;
+
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(clustering_stats_t));
+  }
+}
+
+void clustering_set_summaries(clustering_state_t *state, uint8_t enabled) {
+  state->collect_summaries = enabled;
+}
+
+void clustering_set_motion_gate(clustering_state_t *state, double threshold) {
+  state->motion_gate = !isnan(threshold);
+  state->motion_threshold = threshold;
+  // the cells of the open clusters and their size depend on the gate
+  rebuild_grid(state, state->newest != -1
+                          ? state->table.columns[TAIL_EPOCH][state->newest]
+                          : state->grid_epoch);
+}
+
+unsigned int clustering_summaries(clustering_state_t *state,
+                                  cluster_summary_t *summaries) {
+  unsigned int clusters = (unsigned int)state->next_cluster_id;
+
+  if (summaries != NULL && state->collect_summaries) {
+    memcpy(summaries, state->summaries, sizeof(cluster_summary_t) * clusters);
+
+    for (unsigned int i = 0; i < clusters; i++) {
+      summary_finish(&summaries[i]);
+    }
+  }
+
+  return clusters;
+}
+
+int clustering_set_threads(clustering_state_t *state, int threads) {
+#ifdef _OPENMP
+  if (threads <= 0) {
+    threads = omp_get_max_threads();
+  }
+#else
+  threads = 1;
+#endif
+
+  state->threads = threads;
+  state->thread_best =
+      (int *)realloc(state->thread_best, sizeof(int) * threads);
+  state->thread_score =
+      (double *)realloc(state->thread_score, sizeof(double) * threads);
+
+  return threads;
+}
+
+void clustering_reset(clustering_state_t *state, double distance_threshold,
+                      double time_threshold, double angle_diff_threshold,
+                      double speed_diff_threshold, unsigned int window_size) {
+  for (unsigned int i = 0; i < state->cluster_len; i++) {
+    free(state->clusters[i].indices);
+  }
+
+  for (unsigned int i = state->finished_head; i < state->finished_len; i++) {
+    free(state->finished[i].indices);
+  }
+
+  state->distance_threshold = distance_threshold;
+  state->time_threshold = time_threshold;
+  state->angle_diff_threshold = angle_diff_threshold;
+  state->speed_diff_threshold = speed_diff_threshold;
+  state->window_size = window_size;
+  // the kernel without the gates that pass every point, on the instruction set
+  // that was selected before
+  state->kernel = select_compatibility_kernel(
+      state->kernel_isa, kernel_gates(time_threshold, speed_diff_threshold),
+      &state->kernel_isa);
+  // the last point is always needed for the distance and time checks
+  state->tail_capacity = window_size > 0 ? window_size : 1;
+  state->points_seen = 0;
+  state->next_cluster_id = 0;
+  state->emit_finished = TRUE;
+  state->cluster_len = 0;
+  state->active_len = 0;
+  state->oldest = -1;
+  state->newest = -1;
+  state->free_slot = -1;
+  state->finished_head = 0;
+  state->finished_len = 0;
+  rebuild_grid(state, -INFINITY);
+
+  if (state->stats != NULL) {
+    memset(state->stats, 0, sizeof(clustering_stats_t));
+  }
+
+  // a wider window needs a bigger tail for every slot
+  reserve_clusters(state, state->cluster_capacity);
+}
+
+void reserve_clusters(clustering_state_t *state, unsigned int capacity) {
+  if (capacity > state->cluster_capacity) {
+    state->clusters =
+        (cluster_t *)realloc(state->clusters, sizeof(cluster_t) * capacity);
+    tail_table_reserve(&state->table, capacity);
+
+    // every open cluster can be a candidate of a point
+    state->scan = (int *)realloc(state->scan, sizeof(int) * capacity);
+    state->gate_compatible =
+        (uint8_t *)realloc(state->gate_compatible, sizeof(uint8_t) * capacity);
+    state->gate_distance =
+        (double *)realloc(state->gate_distance, sizeof(double) * capacity);
+    state->gate_angle =
+        (double *)realloc(state->gate_angle, sizeof(double) * capacity);
+    state->cluster_capacity = capacity;
+  }
+
+  if (state->use_grid) {
+    spatial_grid_reserve(&state->grid, capacity);
+  }
+
+  size_t tails_len = (size_t)capacity * state->tail_capacity;
+
+  if (tails_len <= state->tails_len) {
+    return;
+  }
+
+  state->tails = (double(*)[WIDTH])realloc(state->tails,
+                                           sizeof(double[WIDTH]) * tails_len);
+  state->tails_len = tails_len;
+
+  // the open clusters point into the tails of their slots
+  for (int i = state->oldest; i != -1; i = state->clusters[i].newer) {
+    state->clusters[i].tail = state->tails + (size_t)i * state->tail_capacity;
+  }
+}
+
+void clustering_push_points(clustering_state_t *state, double **data,
+                            unsigned int count, int *res) {
+  for (unsigned int i = 0; i < count; i++) {
+    res[i] = clustering_push_point(state, data[i]);
+  }
+}
+
+void clustering_push_strided(clustering_state_t *state, double *data,
+                             unsigned int count, ptrdiff_t row_stride,
+                             ptrdiff_t col_stride, int *res) {
+  double point[WIDTH];
+
+  for (unsigned int i = 0; i < count; i++) {
+    double *row = data + (ptrdiff_t)i * row_stride;
+
+    // rows of a row major buffer are used in place
+    if (col_stride == 1) {
+      res[i] = clustering_push_point(state, row);
+      continue;
+    }
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    res[i] = clustering_push_point(state, point);
+  }
+}
+
+int clustering_push_point(clustering_state_t *state, double *point) {
+  return clustering_push_indexed(state, point, state->points_seen++);
+}
+
+int clustering_push_indexed(clustering_state_t *state, double *point,
+                            unsigned int index) {
+  double unit[3];
+
+  ecef_unit(point, unit);
+
+  return clustering_push_projected(state, point, unit, index);
+}
+
+int clustering_push_projected(clustering_state_t *state, double *point,
+                              double *unit, unsigned int index) {
+  double clock = 0;
+  int id;
+
+  if (STATS_ENABLED(state)) {
+    state->stats->points++;
+    clock = stats_clock();
   }
 
-  get_cluster_array_with_origininal_indices(clusters_array, cluster_len, height,
-                                            res);
-  free_all_clusters(clusters_array, cluster_len);
+  retire_stale_clusters(state, point[EPOCH]);
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->label_seconds, &clock);
+  }
+
+  // the trig of the point is computed once for every cluster it is compared
+  // to, the grid cell and the tail table
+  memcpy(state->point_unit, unit, sizeof(state->point_unit));
+
+  int cluster_loc = find_closest_compatible_cluster(state, point);
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->search_seconds, &clock);
+  }
+
+  if (cluster_loc != -1) {
+    add_to_cluster(state, &state->clusters[cluster_loc], point, index);
+    id = state->clusters[cluster_loc].id;
+  } else {
+    id = add_new_cluster(state, point, index);
+  }
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->append_seconds, &clock);
+  }
+
+  return id;
+}
+
+void clustering_flush(clustering_state_t *state) {
+  double clock = STATS_ENABLED(state) ? stats_clock() : 0;
+
+  while (state->oldest != -1) {
+    finish_cluster(state, state->oldest);
+  }
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->label_seconds, &clock);
+  }
+}
+
+int clustering_next_finished(clustering_state_t *state, unsigned int *len) {
+  if (state->finished_head == state->finished_len) {
+    *len = 0;
+    return -1;
+  }
+
+  *len = state->finished[state->finished_head].len;
+  return state->finished[state->finished_head].id;
+}
+
+void clustering_pop_finished(clustering_state_t *state,
+                             unsigned int *indices) {
+  if (state->finished_head == state->finished_len) {
+    return;
+  }
+
+  cluster_t *cluster = &state->finished[state->finished_head++];
+
+  if (indices != NULL) {
+    memcpy(indices, cluster->indices, sizeof(unsigned int) * cluster->len);
+  }
+
+  free(cluster->indices);
+
+  if (state->finished_head == state->finished_len) {
+    state->finished_head = 0;
+    state->finished_len = 0;
+  }
+}
+
+void clustering_destroy(clustering_state_t *state) {
+  if (state == NULL) {
+    return;
+  }
+
+  for (unsigned int i = state->finished_head; i < state->finished_len; i++) {
+    free(state->finished[i].indices);
+  }
+
+  free_all_clusters(state->clusters, state->cluster_len);
+  spatial_grid_free(&state->grid);
+  tail_table_free(&state->table);
+  free(state->scan);
+  free(state->gate_compatible);
+  free(state->gate_distance);
+  free(state->gate_angle);
+  free(state->thread_best);
+  free(state->thread_score);
+  free(state->tails);
+  free(state->finished);
+  free(state->summaries);
+  free(state);
 }
 
 void print_array_res(int *arr, unsigned int len) {
@@ -47,6 +768,14 @@ double haversine_distance(double *first, double *second) {
   return sqrt(pow(R * c, 2) + pow(second[ALT] - first[ALT], 2));
 }
 
+void ecef_unit(double *point, double *res) {
+  double cos_lat = cos(point[LAT]);
+
+  res[0] = cos_lat * cos(point[LON]);
+  res[1] = cos_lat * sin(point[LON]);
+  res[2] = sin(point[LAT]);
+}
+
 double calc_speed(double *first, double *second) {
   double time_diff = (second[EPOCH] - first[EPOCH]);
 
@@ -57,68 +786,106 @@ double angle_degree(double *first, double *second) {
   return atan2(second[LAT] - first[LAT], second[LON] - first[LON]) * 180 / PI;
 }
 
-double calc_speed_diff(double **data, cluster_t first, unsigned int second,
+double calc_speed_diff(cluster_t *first, double *second,
                        unsigned int window_size, double speed_diff_threshold) {
-  return calc_diff(data, first, second, window_size, calc_speed,
-                   speed_diff_threshold);
+  return calc_diff(first, second, window_size, calc_speed,
+                   first->general_speed, speed_diff_threshold);
 }
 
-double calc_angle_diff(double **data, cluster_t first, unsigned int second,
+double calc_angle_diff(cluster_t *first, double *second,
                        unsigned int window_size, double angle_diff_threshold) {
-  return calc_diff(data, first, second, window_size, angle_degree,
-                   angle_diff_threshold);
+  return calc_diff(first, second, window_size, angle_degree,
+                   first->general_angle, angle_diff_threshold);
+}
+
+double *last_point(cluster_t *cluster) {
+  return cluster->tail[cluster->tail_last];
 }
 
-void mean_between(double **data, cluster_t cluster, double *res_mean,
-                  unsigned int start, unsigned int end) {
+void sum_between(clustering_state_t *state, cluster_t *cluster,
+                 double *res_sum, unsigned int start, unsigned int end) {
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    res_sum[j] = 0;
+  }
+
   for (unsigned int i = start; i < end; i++) {
+    double *point =
+        cluster->tail[(cluster->tail_head + i) % state->tail_capacity];
+
     for (unsigned int j = 0; j < WIDTH; j++) {
-      res_mean[j] += data[cluster.indices[i]][j] / (end - start);
+      res_sum[j] += point[j];
     }
   }
 }
 
-double calc_diff(double **data, cluster_t first, unsigned int second,
-                 unsigned int window_size,
-                 double (*diff_func)(double *, double *), double threshold) {
-  // unsigned int first_angle_window =
-  //     window_size > first.len ? first.len : window_size;
+void update_window(clustering_state_t *state, cluster_t *cluster,
+                   double *leaving) {
+  unsigned int window_size = state->window_size;
 
-  if (window_size > first.len) {
-    return threshold;
+  if (window_size > cluster->len) {
+    return;
   }
 
-  unsigned int start = first.len - window_size;
-  unsigned int end = first.len;
-  unsigned int middle = start + (end - start) / 2;
+  unsigned int first_half = window_size / 2;
+  unsigned int second_half = window_size - first_half;
+
+  // the sums are rebuilt every time the ring wraps around so the rounding of
+  // the running updates can not drift
+  if (leaving == NULL || cluster->tail_head == 0) {
+    sum_between(state, cluster, cluster->first_half_sum, 0, first_half);
+    sum_between(state, cluster, cluster->second_half_sum, first_half,
+                window_size);
+  } else {
+    // the oldest point of the second half moves to the first half
+    double *middle = cluster->tail[(cluster->tail_head + first_half - 1) %
+                                   state->tail_capacity];
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      cluster->first_half_sum[j] += middle[j] - leaving[j];
+      cluster->second_half_sum[j] += last_point(cluster)[j] - middle[j];
+    }
+  }
 
-  double first_half_mean[WIDTH] = {0};
   double second_half_mean[WIDTH] = {0};
 
-  mean_between(data, first, first_half_mean, start, middle);
-  mean_between(data, first, second_half_mean, middle, end);
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    cluster->first_half_mean[j] =
+        first_half ? cluster->first_half_sum[j] / first_half : 0;
+    second_half_mean[j] =
+        second_half ? cluster->second_half_sum[j] / second_half : 0;
+  }
+
+  cluster->general_speed = calc_speed(cluster->first_half_mean, second_half_mean);
+  cluster->general_angle =
+      angle_degree(cluster->first_half_mean, second_half_mean);
+}
 
-  double general_diff = diff_func(first_half_mean, second_half_mean);
+double calc_diff(cluster_t *first, double *second, unsigned int window_size,
+                 double (*diff_func)(double *, double *), double general_diff,
+                 double threshold) {
+  if (window_size > first->len) {
+    return threshold;
+  }
 
-  double new_diff = diff_func(first_half_mean, data[second]);
+  double new_diff = diff_func(first->first_half_mean, second);
 
   return fabs(general_diff - new_diff);
 }
 
-uint8_t check_compatibility(double **data, cluster_t first, unsigned int second,
+uint8_t check_compatibility(cluster_t *first, double *second,
                             double distance_threshold, double time_threshold,
                             double angle_diff_threshold,
                             double speed_diff_threshold,
                             unsigned int window_size, double *res_haversine,
                             double *res_angle) {
-  double *first_cluster_last_element = data[first.indices[first.len - 1]];
-  double *second_element = data[second];
+  double *first_cluster_last_element = last_point(first);
+  double *second_element = second;
   *res_haversine =
       haversine_distance(first_cluster_last_element, second_element);
   double speed_diff =
-      calc_speed_diff(data, first, second, window_size, speed_diff_threshold);
+      calc_speed_diff(first, second, window_size, speed_diff_threshold);
   *res_angle =
-      calc_angle_diff(data, first, second, window_size, angle_diff_threshold);
+      calc_angle_diff(first, second, window_size, angle_diff_threshold);
   double time_diff =
       fabs(second_element[EPOCH] - first_cluster_last_element[EPOCH]);
   return *res_haversine <= distance_threshold &&
@@ -134,76 +901,480 @@ void free_all_clusters(cluster_t *clusters, unsigned int len) {
   free(clusters);
 }
 
-void get_cluster_array_with_origininal_indices(cluster_t *clusters,
-                                               unsigned int len,
-                                               unsigned int number_of_points,
-                                               int *res) {
-  for (unsigned int i = 0; i < len; i++) {
-    for (unsigned int j = 0; j < clusters[i].len; j++) {
-      res[clusters[i].indices[j]] = i;
+int add_new_cluster(clustering_state_t *state, double *point,
+                    unsigned int index) {
+  int slot = state->free_slot;
+
+  if (slot != -1) {
+    state->free_slot = state->clusters[slot].newer;
+  } else {
+    if (state->cluster_len == state->cluster_capacity) {
+      reserve_clusters(state,
+                       state->cluster_capacity ? state->cluster_capacity * 2
+                                               : 16);
     }
+
+    slot = state->cluster_len++;
+  }
+
+  cluster_t *new_cluster = &state->clusters[slot];
+  new_cluster->id = state->next_cluster_id++;
+
+  if (state->collect_summaries) {
+    if ((unsigned int)new_cluster->id >= state->summaries_capacity) {
+      state->summaries_capacity = state->summaries_capacity
+                                      ? state->summaries_capacity * 2
+                                      : 16;
+      state->summaries = (cluster_summary_t *)realloc(
+          state->summaries,
+          sizeof(cluster_summary_t) * state->summaries_capacity);
+    }
+
+    summary_add_point(&state->summaries[new_cluster->id], NULL, point);
+  }
+
+  if (STATS_ENABLED(state)) {
+    state->stats->clusters_created++;
+  }
+
+  new_cluster->len = 1;
+  new_cluster->indices = NULL;
+  new_cluster->indices_capacity = 0;
+
+  if (state->emit_finished) {
+    new_cluster->indices_capacity = 4;
+    new_cluster->indices = (unsigned int *)malloc(
+        sizeof(unsigned int) * new_cluster->indices_capacity);
+    new_cluster->indices[0] = index;
+  }
+
+  new_cluster->tail_len = 1;
+  new_cluster->tail_head = 0;
+  new_cluster->tail_last = 0;
+  new_cluster->tail = state->tails + (size_t)slot * state->tail_capacity;
+  memcpy(new_cluster->tail[0], point, sizeof(double[WIDTH]));
+  memcpy(new_cluster->previous, point, sizeof(double[WIDTH]));
+  update_window(state, new_cluster, NULL);
+  update_tail_table(state, slot);
+
+  link_newest_cluster(state, slot);
+
+  if (state->use_grid) {
+    spatial_grid_insert(&state->grid, slot, cluster_cell(state, slot));
   }
+
+  return new_cluster->id;
 }
 
-void add_new_cluster(cluster_t **clusters_array, unsigned int *cluster_len,
-                     unsigned int index) {
-  cluster_t *temp =
-      (cluster_t *)malloc(sizeof(cluster_t) * ((*cluster_len) + 1));
+void add_to_cluster(clustering_state_t *state, cluster_t *cluster,
+                    double *point, unsigned int index) {
+  if (state->collect_summaries) {
+    summary_add_point(&state->summaries[cluster->id], last_point(cluster),
+                      point);
+  }
+
+  if (cluster->indices != NULL) {
+    if (cluster->len == cluster->indices_capacity) {
+      cluster->indices_capacity *= 2;
+      cluster->indices = (unsigned int *)realloc(
+          cluster->indices, sizeof(unsigned int) * cluster->indices_capacity);
+    }
+
+    cluster->indices[cluster->len] = index;
+  }
+
+  cluster->len++;
+  memcpy(cluster->previous, last_point(cluster), sizeof(double[WIDTH]));
+
+  double leaving[WIDTH];
+  uint8_t window_was_full = cluster->len > state->window_size;
+
+  cluster->tail_last = (cluster->tail_last + 1) % state->tail_capacity;
 
-  for (unsigned int i = 0; i < *cluster_len; i++) {
-    temp[i] = (*clusters_array)[i];
+  if (cluster->tail_len == state->tail_capacity) {
+    // the ring is full, the oldest point is overwritten
+    memcpy(leaving, cluster->tail[cluster->tail_head], sizeof(leaving));
+    cluster->tail_head = (cluster->tail_head + 1) % state->tail_capacity;
+  } else {
+    cluster->tail_len++;
   }
 
-  cluster_t new_cluster;
-  new_cluster.len = 1;
-  new_cluster.indices =
-      (unsigned int *)malloc(sizeof(unsigned int) * new_cluster.len);
-  new_cluster.indices[0] = index;
+  memcpy(cluster->tail[cluster->tail_last], point, sizeof(double[WIDTH]));
+  update_window(state, cluster, window_was_full ? leaving : NULL);
 
-  temp[*cluster_len] = new_cluster;
+  int slot = (int)(cluster - state->clusters);
+  update_tail_table(state, slot);
 
-  free(*clusters_array);
-  *clusters_array = temp;
-  (*cluster_len)++;
+  // the stream is sorted by epoch so the cluster now has the newest last point
+  unlink_cluster(state, slot);
+  link_newest_cluster(state, slot);
+
+  if (state->use_grid) {
+    spatial_grid_move(&state->grid, slot, cluster_cell(state, slot));
+  }
 }
 
-void add_to_cluster(cluster_t *clusters_array, unsigned int cluster_index,
-                    unsigned int index) {
-  unsigned int *temp = (unsigned int *)malloc(
-      sizeof(unsigned int) * (clusters_array[cluster_index].len + 1));
-  for (unsigned int i = 0; i < clusters_array[cluster_index].len; i++) {
-    temp[i] = clusters_array[cluster_index].indices[i];
+void unlink_cluster(clustering_state_t *state, int slot) {
+  cluster_t *cluster = &state->clusters[slot];
+
+  if (cluster->older != -1) {
+    state->clusters[cluster->older].newer = cluster->newer;
+  } else {
+    state->oldest = cluster->newer;
   }
 
-  temp[clusters_array[cluster_index].len] = index;
-  free(clusters_array[cluster_index].indices);
+  if (cluster->newer != -1) {
+    state->clusters[cluster->newer].older = cluster->older;
+  } else {
+    state->newest = cluster->older;
+  }
 
-  clusters_array[cluster_index].len++;
-  clusters_array[cluster_index].indices = temp;
+  state->active_len--;
 }
 
-int find_closest_compatible_cluster(
-    double **data, unsigned int height, cluster_t *clusters_array,
-    unsigned int cluster_len, unsigned int index, double distance_threshold,
-    double time_threshold, double angle_diff_threshold,
-    double speed_diff_threshold, unsigned int window_size) {
+void link_newest_cluster(clustering_state_t *state, int slot) {
+  cluster_t *cluster = &state->clusters[slot];
+
+  cluster->older = state->newest;
+  cluster->newer = -1;
+
+  if (state->newest != -1) {
+    state->clusters[state->newest].newer = slot;
+  } else {
+    state->oldest = slot;
+  }
+
+  state->newest = slot;
+  state->active_len++;
+}
+
+void retire_stale_clusters(clustering_state_t *state, double epoch) {
+  // the active list is ordered by the epoch of the last point so the stale
+  // clusters are all at its oldest end
+  while (state->oldest != -1) {
+    cluster_t *cluster = &state->clusters[state->oldest];
+
+    if (epoch - last_point(cluster)[EPOCH] <=
+        state->time_threshold) {
+      break;
+    }
+
+    finish_cluster(state, state->oldest);
+  }
+}
+
+void finish_cluster(clustering_state_t *state, int slot) {
+  cluster_t *cluster = &state->clusters[slot];
+
+  unlink_cluster(state, slot);
+
+  if (state->use_grid) {
+    spatial_grid_remove(&state->grid, slot);
+  }
+
+  if (STATS_ENABLED(state)) {
+    state->stats->clusters_finished++;
+  }
+
+  cluster->tail = NULL;
+
+  if (state->emit_finished) {
+    if (state->finished_len == state->finished_capacity &&
+        state->finished_head > 0) {
+      memmove(state->finished, state->finished + state->finished_head,
+              sizeof(cluster_t) * (state->finished_len - state->finished_head));
+      state->finished_len -= state->finished_head;
+      state->finished_head = 0;
+    }
+
+    if (state->finished_len == state->finished_capacity) {
+      unsigned int capacity =
+          state->finished_capacity ? state->finished_capacity * 2 : 16;
+      state->finished =
+          (cluster_t *)realloc(state->finished, sizeof(cluster_t) * capacity);
+      state->finished_capacity = capacity;
+    }
+
+    state->finished[state->finished_len++] = *cluster;
+  } else {
+    free(cluster->indices);
+  }
+
+  cluster->indices = NULL;
+  cluster->newer = state->free_slot;
+  state->free_slot = slot;
+}
+
+void update_tail_table(clustering_state_t *state, int slot) {
+  cluster_t *cluster = &state->clusters[slot];
+  double **columns = state->table.columns;
+  double *last = last_point(cluster);
+  double mean_unit[3];
+
+  columns[TAIL_LAT][slot] = last[LAT];
+  columns[TAIL_LON][slot] = last[LON];
+  columns[TAIL_ALT][slot] = last[ALT];
+  columns[TAIL_EPOCH][slot] = last[EPOCH];
+  // the last point is the point being clustered
+  columns[TAIL_X][slot] = state->point_unit[0];
+  columns[TAIL_Y][slot] = state->point_unit[1];
+  columns[TAIL_Z][slot] = state->point_unit[2];
+  columns[MEAN_LAT][slot] = cluster->first_half_mean[LAT];
+  columns[MEAN_LON][slot] = cluster->first_half_mean[LON];
+  columns[MEAN_ALT][slot] = cluster->first_half_mean[ALT];
+  columns[MEAN_EPOCH][slot] = cluster->first_half_mean[EPOCH];
+  ecef_unit(cluster->first_half_mean, mean_unit);
+  columns[MEAN_X][slot] = mean_unit[0];
+  columns[MEAN_Y][slot] = mean_unit[1];
+  columns[MEAN_Z][slot] = mean_unit[2];
+  columns[GENERAL_SPEED][slot] = cluster->general_speed;
+  columns[GENERAL_ANGLE][slot] = cluster->general_angle;
+  columns[WINDOW_READY][slot] = cluster->len >= state->window_size;
+
+  // the velocity from the oldest to the last point of the tail, the motion
+  // gate moves the last point by it. a tail of one point has no velocity, so
+  // it is taken from the point before
+  double *first = state->tail_capacity > 1 ? cluster->tail[cluster->tail_head]
+                                           : cluster->previous;
+  double elapsed = last[EPOCH] - first[EPOCH];
+
+  if (state->motion_gate && elapsed > 0) {
+    double first_unit[3];
+    ecef_unit(first, first_unit);
+
+    for (unsigned int i = 0; i < 3; i++) {
+      columns[VELOCITY_X + i][slot] =
+          (state->point_unit[i] - first_unit[i]) / elapsed;
+    }
+
+    columns[VELOCITY_ALT][slot] = (last[ALT] - first[ALT]) / elapsed;
+    columns[DISTANCE_GATE][slot] = state->motion_threshold;
+  } else {
+    columns[VELOCITY_X][slot] = 0;
+    columns[VELOCITY_Y][slot] = 0;
+    columns[VELOCITY_Z][slot] = 0;
+    columns[VELOCITY_ALT][slot] = 0;
+    columns[DISTANCE_GATE][slot] = state->distance_threshold;
+  }
+}
+
+void rebuild_grid(clustering_state_t *state, double epoch) {
+  double reach = state->distance_threshold;
+
+  // a cluster with a velocity is keyed by its position at `epoch`, the cells
+  // are made wide enough that it can drift as far as its own threshold
+  if (state->motion_gate) {
+    reach = fmax(reach, 2 * state->motion_threshold);
+  }
+
+  state->use_grid = spatial_grid_reset(&state->grid, reach);
+  state->grid_epoch = epoch;
+  state->grid_speed = 0;
+  state->grid_drift =
+      state->motion_gate ? reach - state->motion_threshold : INFINITY;
+
+  if (!state->use_grid) {
+    return;
+  }
+
+  spatial_grid_reserve(&state->grid, state->cluster_capacity);
+
+  for (int i = state->oldest; i != -1; i = state->clusters[i].newer) {
+    spatial_grid_insert(&state->grid, i, cluster_cell(state, i));
+  }
+}
+
+int32_t *cluster_cell(clustering_state_t *state, int slot) {
+  double **columns = state->table.columns;
+  double unit[3] = {columns[TAIL_X][slot], columns[TAIL_Y][slot],
+                    columns[TAIL_Z][slot]};
+
+  if (state->motion_gate) {
+    double elapsed = state->grid_epoch - columns[TAIL_EPOCH][slot];
+    double speed = 0;
+
+    for (unsigned int i = 0; i < 3; i++) {
+      double velocity = columns[VELOCITY_X + i][slot];
+
+      unit[i] += velocity * elapsed;
+      speed += velocity * velocity;
+    }
+
+    state->grid_speed = fmax(state->grid_speed, sqrt(speed) * R);
+  }
+
+  return spatial_grid_cell(&state->grid, unit);
+}
+
+unsigned int collect_candidates(clustering_state_t *state, int **candidates) {
+  if (state->use_grid) {
+    // only clusters whose last point is in a neighboring cell can be within
+    // the distance threshold
+    unsigned int count = spatial_grid_query(
+        &state->grid, spatial_grid_cell(&state->grid, state->point_unit));
+    *candidates = state->grid.candidates;
+    return count;
+  }
+
+  unsigned int count = 0;
+
+  for (int i = state->oldest; i != -1; i = state->clusters[i].newer) {
+    state->scan[count++] = i;
+  }
+
+  *candidates = state->scan;
+  return count;
+}
+
+int find_closest_compatible_cluster(clustering_state_t *state, double *point) {
+  int *candidates = NULL;
+  gate_t gate;
+
+  prepare_search(state, point, &gate);
+
+  unsigned int count = collect_candidates(state, &candidates);
+  int min_index = reduce_candidates(state, candidates, count, point, &gate);
+
+  if (STATS_ENABLED(state)) {
+    record_candidates(state, candidates, count, point, &gate);
+  }
+
+  return min_index;
+}
+
+void prepare_search(clustering_state_t *state, double *point, gate_t *gate) {
+  // a cluster is keyed by its position at `grid_epoch`, by the time of the
+  // point it moved at most `grid_speed` times the elapsed seconds from it, so
+  // the neighbor cells only cover it while that is within `grid_drift`. the
+  // first point always rebuilds because the drift of an empty grid is not a
+  // number
+  if (state->motion_gate && state->use_grid &&
+      !(state->grid_speed * (point[EPOCH] - state->grid_epoch) <=
+        state->grid_drift)) {
+    rebuild_grid(state, point[EPOCH]);
+  }
+
+  gate->distance_threshold = state->distance_threshold;
+  gate->time_threshold = state->time_threshold;
+  gate->angle_diff_threshold = state->angle_diff_threshold;
+  gate->speed_diff_threshold = state->speed_diff_threshold;
+  memcpy(gate->unit, state->point_unit, sizeof(gate->unit));
+  gate->motion = state->motion_gate;
+}
+
+int reduce_candidates(clustering_state_t *state, int *candidates,
+                      unsigned int count, double *point, gate_t *gate) {
   int min_index = -1;
   double min_value = INFINITY;
 
-  for (unsigned int i = 0; i < cluster_len; i++) {
-    double haversine_distance = 0;
-    double angle_ditstance = 0;
+#ifdef _OPENMP
+  if (state->threads > 1 && count >= PARALLEL_MIN_CANDIDATES) {
+    int threads = state->threads;
+
+#pragma omp parallel num_threads(threads)
+    {
+      int thread = omp_get_thread_num();
+      int team = omp_get_num_threads();
+
+      // every thread reduces a contiguous range, the team can be smaller
+      // than requested so the ranges are split by the actual team size
+      state->thread_score[thread] = INFINITY;
+      state->thread_best[thread] = closest_candidate(
+          state, candidates, (unsigned int)((size_t)count * thread / team),
+          (unsigned int)((size_t)count * (thread + 1) / team), point, gate,
+          &state->thread_score[thread]);
+
+#pragma omp single
+      threads = team;
+    }
+
+    for (int i = 0; i < threads; i++) {
+      if (state->thread_best[i] != -1) {
+        consider_candidate(state, state->thread_best[i],
+                           state->thread_score[i], &min_index, &min_value);
+      }
+    }
+
+    return min_index;
+  }
+#endif
+
+  min_index = closest_candidate(state, candidates, 0, count, point, gate,
+                                &min_value);
+
+  return min_index;
+}
+
+void record_candidates(clustering_state_t *state, int *candidates,
+                       unsigned int count, double *point, gate_t *gate) {
+  clustering_stats_t *stats = state->stats;
+
+  stats_add_candidates(stats, count);
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (state->gate_compatible[i] == TRUE) {
+      stats->compatible++;
+      continue;
+    }
+
+    // the kernel only says a candidate failed or could not win, so the gates
+    // are evaluated again one by one
+    cluster_t *cluster = &state->clusters[candidates[i]];
+    double *last = last_point(cluster);
+    uint8_t rejected_distance =
+        !(gate_distance(&state->table, candidates[i], point, gate) <=
+          state->table.columns[DISTANCE_GATE][candidates[i]]);
+    uint8_t rejected_time =
+        !(fabs(point[EPOCH] - last[EPOCH]) <= state->time_threshold);
+    uint8_t rejected_angle =
+        !(calc_angle_diff(cluster, point, state->window_size,
+                          state->angle_diff_threshold) <=
+          state->angle_diff_threshold);
+    uint8_t rejected_speed =
+        !(calc_speed_diff(cluster, point, state->window_size,
+                          state->speed_diff_threshold) <=
+          state->speed_diff_threshold);
+
+    stats->pruned += state->gate_compatible[i] == KERNEL_PRUNED;
+    stats->compatible += !(rejected_distance || rejected_time ||
+                           rejected_angle || rejected_speed);
+    stats->rejected_distance += rejected_distance;
+    stats->rejected_time += rejected_time;
+    stats->rejected_angle += rejected_angle;
+    stats->rejected_speed += rejected_speed;
+  }
+}
+
+int closest_candidate(clustering_state_t *state, int *candidates,
+                      unsigned int start, unsigned int end, double *point,
+                      gate_t *gate, double *min_value) {
+  int min_index = -1;
+  double bound = *min_value;
+
+  state->kernel(&state->table, candidates + start, end - start, point, gate,
+                &bound, state->gate_compatible + start,
+                state->gate_distance + start, state->gate_angle + start);
 
-    if (check_compatibility(data, clusters_array[i], index, distance_threshold,
-                            time_threshold, angle_diff_threshold,
-                            speed_diff_threshold, window_size,
-                            &haversine_distance, &angle_ditstance) &&
-        sqrt(pow(haversine_distance, 2) + pow(angle_ditstance, 2)) <=
-            min_value) {
-      min_index = i;
-      min_value = min_value;
+  for (unsigned int i = start; i < end; i++) {
+    if (state->gate_compatible[i] == TRUE) {
+      consider_candidate(state, candidates[i],
+                         sqrt(pow(state->gate_distance[i], 2) +
+                              pow(state->gate_angle[i], 2)),
+                         &min_index, min_value);
     }
   }
 
   return min_index;
-}
\ No newline at end of file
+}
+
+void consider_candidate(clustering_state_t *state, int slot, double value,
+                        int *min_index, double *min_value) {
+  // the candidates are not in creation order, so the tie between equally
+  // close clusters goes to the older cluster explicitly
+  if (value < *min_value ||
+      (value == *min_value && *min_index != -1 &&
+       state->clusters[slot].id < state->clusters[*min_index].id)) {
+    *min_index = slot;
+    *min_value = value;
+  }
+}
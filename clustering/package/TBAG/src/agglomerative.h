@@ -1,28 +1,124 @@
+#ifndef AGGLOMERATIVE_H
+#define AGGLOMERATIVE_H
+
 #define _USE_MATH_DEFINES
 
 #include <malloc.h>
 #include <math.h>
-// #include <omp.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "simd_kernel.h"
+#include "spatial_grid.h"
+#include "stats.h"
+#include "summary.h"
 
 #define R 6371000
 #define FALSE 0
 #define TRUE !FALSE
 #define PI 3.14159265359
 #define WIDTH 4
+// below this many candidates the threads cost more than the scan they share
+#define PARALLEL_MIN_CANDIDATES 512
 
 enum columns { LAT, LON, ALT, EPOCH };
 
 typedef struct cluster_s {
+  int id;
   unsigned int len;
   unsigned int* indices;
+  unsigned int indices_capacity;
+  unsigned int tail_len;
+  unsigned int tail_head;
+  unsigned int tail_last;
+  double (*tail)[WIDTH];
+  // point before the last one, the velocity of the motion gate starts from it
+  // when the tail only holds the last point
+  double previous[WIDTH];
+  double first_half_sum[WIDTH];
+  double second_half_sum[WIDTH];
+  double first_half_mean[WIDTH];
+  double general_speed;
+  double general_angle;
+  int older;
+  int newer;
 } cluster_t;
 
+typedef struct clustering_state_s {
+  double distance_threshold;
+  double time_threshold;
+  double angle_diff_threshold;
+  double speed_diff_threshold;
+  unsigned int window_size;
+  unsigned int tail_capacity;
+  unsigned int points_seen;
+  int next_cluster_id;
+  uint8_t emit_finished;
+  cluster_t* clusters;
+  unsigned int cluster_len;
+  unsigned int cluster_capacity;
+  double (*tails)[WIDTH];
+  size_t tails_len;
+  unsigned int active_len;
+  int oldest;
+  int newest;
+  int free_slot;
+  // earth centered unit vector of the point being clustered
+  double point_unit[3];
+  uint8_t use_grid;
+  spatial_grid_t grid;
+  uint8_t motion_gate;
+  // distance threshold of the clusters with a velocity with the motion gate
+  double motion_threshold;
+  // epoch the clusters are moved to for their grid cells with the motion gate
+  double grid_epoch;
+  // fastest cluster in the grid since `grid_epoch` in meters per second
+  double grid_speed;
+  // meters a cluster may move from its cell before the grid is rebuilt
+  double grid_drift;
+  tail_table_t table;
+  compatibility_kernel_t kernel;
+  int kernel_isa;
+  int* scan;
+  uint8_t* gate_compatible;
+  double* gate_distance;
+  double* gate_angle;
+  int threads;
+  int* thread_best;
+  double* thread_score;
+  clustering_stats_t* stats;
+  uint8_t collect_summaries;
+  // summaries of the clusters of the stream by id
+  cluster_summary_t* summaries;
+  unsigned int summaries_capacity;
+  cluster_t* finished;
+  unsigned int finished_head;
+  unsigned int finished_len;
+  unsigned int finished_capacity;
+} clustering_state_t;
+
+typedef struct clustering_params_s {
+  double distance_threshold;
+  double time_threshold;
+  double angle_diff_threshold;
+  double speed_diff_threshold;
+  unsigned int window_size;
+} clustering_params_t;
+
+typedef struct scene_order_s {
+  unsigned int len;
+  unsigned int scene;
+} scene_order_t;
+
 /// @brief cluster data points with respect to the location, speed,
 /// and direction of trajectories
-/// @param data array of points
+/// @param data array of points sorted by epoch ascending
 /// @param height number of data points
 /// @param distance_threshold maximum distance between last point od one cluster
 /// and first point of second cluster
@@ -39,6 +135,234 @@ void agglomerative_clustering(double** data, unsigned int height,
                               double speed_diff_threshold,
                               unsigned int window_size, int* res);
 
+/// @brief cluster data points like `agglomerative_clustering` using the
+/// storage of a caller owned state, runs that fit in the storage of a previous
+/// run do not allocate
+/// @param arena state from `clustering_init` that is reset for this run and
+/// keeps its storage afterwards, free it with `clustering_destroy`
+void agglomerative_clustering_with_arena(
+    clustering_state_t* arena, double** data, unsigned int height,
+    double distance_threshold, double time_threshold,
+    double angle_diff_threshold, double speed_diff_threshold,
+    unsigned int window_size, int* res);
+
+/// @brief cluster data points like `agglomerative_clustering` straight from a
+/// flat buffer, row major and column major (NumPy) layouts work without
+/// copying or building a row pointer table
+/// @param arena caller owned state to reuse like in
+/// `agglomerative_clustering_with_arena`, NULL to use a temporary state
+/// @param data pointer to the LAT value of the first point
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns of a
+/// point
+void agglomerative_clustering_strided(
+    clustering_state_t* arena, double* data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int* res);
+
+/// @brief cluster data points like `agglomerative_clustering_strided` in time
+/// shards on all cores, then stitch the clusters across the shard boundaries
+/// @param shards number of contiguous shards the points are split into, 0 for
+/// one per core
+/// @details the points after a boundary are clustered again in the state that
+/// went through every point before it, until its open clusters are the ones
+/// the shard found on its own, from there on the labels of the shard are
+/// kept, so the labels are the ones of a single pass. a shard whose state never
+/// catches up is replayed whole, like with an infinite `time_threshold` where
+/// the clusters of the earlier shards stay open
+void agglomerative_clustering_sharded(
+    double* data, unsigned int height, ptrdiff_t row_stride,
+    ptrdiff_t col_stride, unsigned int shards, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int* res);
+
+/// @brief cluster many independent scenes of one concatenated buffer in one
+/// call, the scenes are spread over a pool of threads that each reuse one
+/// arena, largest first so the small scenes fill up the threads at the end
+/// @param data pointer to the LAT value of the first point of the first scene
+/// @param scenes number of scenes
+/// @param offsets array of `scenes + 1` point offsets, the points of scene `i`
+/// are `offsets[i]` up to `offsets[i + 1]`
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param params array of the parameters of every scene
+/// @param threads number of threads, 0 or less for one per core
+/// @param res result array of all the points, the cluster ids of every scene
+/// start from 0
+void agglomerative_clustering_batch(double* data, unsigned int scenes,
+                                    unsigned int* offsets,
+                                    ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                    clustering_params_t* params, int threads,
+                                    int* res);
+
+/// @brief cluster the same points with many parameter sets in one call, the
+/// points are read and projected on the unit sphere once and the parameter
+/// sets are spread over a pool of threads that each reuse one arena
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points, sorted by epoch ascending
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param params array of the parameter sets
+/// @param count number of parameter sets
+/// @param threads number of threads, 0 or less for one per core
+/// @param res result matrix of `count` rows of `height` cluster ids, one row
+/// per parameter set
+/// @param clusters result array of the number of clusters of every parameter
+/// set
+void agglomerative_clustering_sweep(double* data, unsigned int height,
+                                    ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                    clustering_params_t* params,
+                                    unsigned int count, int threads, int* res,
+                                    unsigned int* clusters);
+
+/// @brief order scenes by their number of points, largest first
+/// @param first first scene
+/// @param second second scene
+/// @return qsort comparison result
+int compare_scene_order(const void* first, const void* second);
+
+/// @brief create a persistent clustering state that points can be pushed into
+/// incrementally, see `agglomerative_clustering` for the parameters
+/// @return the new state, NULL if allocation failed
+clustering_state_t* clustering_init(double distance_threshold,
+                                    double time_threshold,
+                                    double angle_diff_threshold,
+                                    double speed_diff_threshold,
+                                    unsigned int window_size);
+
+/// @brief choose the compatibility kernel of the state
+/// @param state clustering state
+/// @param isa one of `kernel_isa`, every kernel decides the gates like
+/// `check_compatibility`, see KERNEL_TOLERANCE for the distances and angles
+/// @return the instruction set of the selected kernel, the widest one the cpu
+/// supports up to the requested one
+int clustering_set_kernel(clustering_state_t* state, int isa);
+
+/// @brief choose how many threads evaluate the candidates of a point, the
+/// labels do not depend on the number of threads
+/// @param state clustering state
+/// @param threads number of threads, 0 or less for one per core
+/// @return the number of threads that will be used, always 1 when the library
+/// is built without OpenMP
+int clustering_set_threads(clustering_state_t* state, int threads);
+
+/// @brief collect run statistics into a caller owned struct, the struct is
+/// zeroed now and on every reset, so after a batch call on an arena it holds
+/// the stats of that call and for a stream it adds up every push
+/// @param state clustering state
+/// @param stats stats to fill, NULL to stop collecting
+void clustering_set_stats(clustering_state_t* state,
+                          clustering_stats_t* stats);
+
+/// @brief summarize every cluster as its points are pushed, see
+/// `clustering_summaries`
+/// @param state clustering state
+/// @param enabled TRUE to collect the summaries, set it before the first point
+/// of a stream
+void clustering_set_summaries(clustering_state_t* state, uint8_t enabled);
+
+/// @brief copy the summaries of every cluster of the stream so far
+/// @param state clustering state collecting summaries
+/// @param summaries array to copy the summaries to, by cluster id, NULL to
+/// only count the clusters
+/// @return the number of clusters
+unsigned int clustering_summaries(clustering_state_t* state,
+                                  cluster_summary_t* summaries);
+
+/// @brief gate the clusters that have a velocity at `threshold` of their last
+/// point moved by the velocity to the epoch of the point instead of at
+/// `distance_threshold` of the last point, so fast clusters can be gated much
+/// tighter while new clusters are still found at `distance_threshold`
+/// @param state clustering state
+/// @param threshold maximum distance between a point and the predicted position
+/// of a cluster in meters, NAN to gate every cluster at its last point. it is
+/// kept by `clustering_reset` and should be set before the first point
+void clustering_set_motion_gate(clustering_state_t* state, double threshold);
+
+/// @brief drop every cluster of the state and start a new stream with new
+/// parameters, the storage of the state is kept for reuse
+/// @param state clustering state
+void clustering_reset(clustering_state_t* state, double distance_threshold,
+                      double time_threshold, double angle_diff_threshold,
+                      double speed_diff_threshold, unsigned int window_size);
+
+/// @brief make room for `capacity` cluster slots and their tails
+/// @param state clustering state
+/// @param capacity number of slots
+void reserve_clusters(clustering_state_t* state, unsigned int capacity);
+
+/// @brief cluster the next points of the stream, points are numbered in the
+/// order they are pushed starting from 0
+/// @param state clustering state
+/// @param data array of points, sorted by epoch ascending and not older than
+/// any point pushed before
+/// @param count number of points in data
+/// @param res result array of cluster ids for the pushed points
+void clustering_push_points(clustering_state_t* state, double** data,
+                            unsigned int count, int* res);
+
+/// @brief cluster the next points of the stream from a flat buffer, see
+/// `agglomerative_clustering_strided` for the layout
+/// @param state clustering state
+/// @param data pointer to the LAT value of the first point
+/// @param count number of points in data
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param res result array of cluster ids for the pushed points
+void clustering_push_strided(clustering_state_t* state, double* data,
+                             unsigned int count, ptrdiff_t row_stride,
+                             ptrdiff_t col_stride, int* res);
+
+/// @brief cluster the next point of the stream
+/// @param state clustering state
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @return the cluster id of the point
+int clustering_push_point(clustering_state_t* state, double* point);
+
+/// @brief cluster the next point of the stream under a caller given index,
+/// for feeds whose points reach the state in another order than they arrived
+/// @param state clustering state
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point, not older
+/// than any point pushed before
+/// @param index stream index of the point in the finished clusters
+/// @return the cluster id of the point
+int clustering_push_indexed(clustering_state_t* state, double* point,
+                            unsigned int index);
+
+/// @brief cluster the next point of the stream like `clustering_push_indexed`
+/// with its unit vector computed ahead, for callers that cluster the same
+/// points many times
+/// @param state clustering state
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @param unit unit vector of the point, see `ecef_unit`
+/// @param index stream index of the point in the finished clusters
+/// @return the cluster id of the point
+int clustering_push_projected(clustering_state_t* state, double* point,
+                              double* unit, unsigned int index);
+
+/// @brief close all open clusters, this should be called at the end of the
+/// stream so the remaining clusters are emitted as finished
+/// @param state clustering state
+void clustering_flush(clustering_state_t* state);
+
+/// @brief get the oldest finished cluster without removing it
+/// @param state clustering state
+/// @param len pointer to the number of points in the finished cluster
+/// @return the id of the finished cluster, -1 if there is none
+int clustering_next_finished(clustering_state_t* state, unsigned int* len);
+
+/// @brief remove the oldest finished cluster
+/// @param state clustering state
+/// @param indices array of at least `len` elements (see
+/// `clustering_next_finished`) to copy the stream indices of the cluster
+/// points to, can be NULL
+void clustering_pop_finished(clustering_state_t* state, unsigned int* indices);
+
+/// @brief free the clustering state and all of its clusters
+/// @param state clustering state
+void clustering_destroy(clustering_state_t* state);
+
 /// @brief calculate the distance between two data points using the haversine
 /// formula
 /// @param first first data point
@@ -46,6 +370,13 @@ void agglomerative_clustering(double** data, unsigned int height,
 /// @return the distance in meters
 double haversine_distance(double* first, double* second);
 
+/// @brief project a data point on the earth centered unit sphere, the
+/// haversine distance of two points follows from the chord between their unit
+/// vectors without any trig of the pair
+/// @param point data point
+/// @param res result array of the x, y, z coordinates
+void ecef_unit(double* point, double* res);
+
 /// @brief print array of clusterids
 /// @param arr array to print
 /// @param len length of the array
@@ -58,35 +389,28 @@ void print_array_res(int* arr, unsigned int len);
 double calc_speed(double* first, double* second);
 
 /// @brief calculate the variance between two clusters angles given a window
-/// @param data data points
 /// @param first first cluster
-/// @param second second cluster
+/// @param second new contender point
 /// @param window_size window frame to calc variance on
 /// @param angle_diff_threshold value to return if cluster is small
 /// @return the angle difference between the two clusters
-double calc_angle_diff(double** data, cluster_t first, unsigned int second,
+double calc_angle_diff(cluster_t* first, double* second,
                        unsigned int window_size, double angle_diff_threshold);
 
+/// @brief get the last point of a cluster
+/// @param cluster open cluster
+/// @return pointer to the last point in the tail of the cluster
+double* last_point(cluster_t* cluster);
+
 /// @brief calculate the angle between two points
 /// @param first first data point
 /// @param second second data point
 /// @return angle between two points in degrees
 double angle_degree(double* first, double* second);
 
-/// @brief raorganize the cluster array to a valid clusterid per index
-/// @param clusters array of clusters
-/// @param len number of clusters in the array
-/// @param number_of_points number of points in the original array
-/// @param res result array
-void get_cluster_array_with_origininal_indices(cluster_t* clusters,
-                                               unsigned int len,
-                                               unsigned int number_of_points,
-                                               int* res);
-
-/// @brief check if two clusters are compatible
-/// @param data array of points
-/// @param first first cluster
-/// @param second second cluster
+/// @brief check if a cluster and a new point are compatible
+/// @param first existing cluster
+/// @param second new contender point
 /// @param distance_threshold maximum distance between last point od one cluster
 /// and first point of second cluster
 /// @param time_threshold maximum time diff allowed between points
@@ -98,81 +422,227 @@ void get_cluster_array_with_origininal_indices(cluster_t* clusters,
 /// @param res_haversine pointer to result phyisical distance
 /// @param res_angle pointer to result angle distance
 /// @return boolean value indicating if the clusters are compatible
-uint8_t check_compatibility(double** data, cluster_t first, unsigned int second,
+uint8_t check_compatibility(cluster_t* first, double* second,
                             double distance_threshold, double time_threshold,
                             double angle_diff_threshold,
                             double speed_diff_threshold,
                             unsigned int window_size, double* res_haversine,
                             double* res_angle);
 
-/// @brief free all clusters
+/// @brief free all clusters, clusters that were already released should have
+/// NULL storage
 /// @param clusters cluster array to free
 /// @param len length of cluster array to free
 void free_all_clusters(cluster_t* clusters, unsigned int len);
 
-/// @brief add new cluster to the cluster array
-/// @param clusters_array pointer to the cluster of existing arrays
-/// @param cluster_len pointer to the length of the current cluster array
-/// @param index index of the element that will be added as a new cluster
-void add_new_cluster(cluster_t** clusters_array, unsigned int* cluster_len,
-                     unsigned int index);
-
-/// @brief add new element to existing cluster
-/// @param clusters_array array of existing clusters
-/// @param cluster_index index of cluster to add element to
-/// @param index element to add to cluster
-void add_to_cluster(cluster_t* clusters_array, unsigned int cluster_index,
+/// @brief add new cluster to the open clusters of the state as the cluster
+/// with the newest last point
+/// @param state clustering state
+/// @param point the element that will be added as a new cluster
+/// @param index stream index of the element
+/// @return the id of the new cluster
+int add_new_cluster(clustering_state_t* state, double* point,
                     unsigned int index);
 
+/// @brief add new element to existing cluster, the cluster becomes the one with
+/// the newest last point
+/// @param state clustering state
+/// @param cluster cluster to add element to
+/// @param point element to add to cluster
+/// @param index stream index of the element
+void add_to_cluster(clustering_state_t* state, cluster_t* cluster,
+                    double* point, unsigned int index);
+
+/// @brief close the open clusters that can no longer accept points because
+/// their last point is more than `time_threshold` older than `epoch`, only the
+/// oldest end of the active list is visited
+/// @param state clustering state
+/// @param epoch epoch of the newest point in the stream
+void retire_stale_clusters(clustering_state_t* state, double epoch);
+
+/// @brief remove an open cluster from the active list, release its window
+/// storage and move it to the queue of finished clusters if they are emitted
+/// @param state clustering state
+/// @param slot slot of the open cluster to close
+void finish_cluster(clustering_state_t* state, int slot);
+
+/// @brief unlink a cluster from the active list
+/// @param state clustering state
+/// @param slot slot of the cluster to unlink
+void unlink_cluster(clustering_state_t* state, int slot);
+
+/// @brief link a cluster at the newest end of the active list
+/// @param state clustering state
+/// @param slot slot of the cluster to link
+void link_newest_cluster(clustering_state_t* state, int slot);
+
+/// @brief cluster the points of a shard again in the state that went through
+/// every point before it, until the open clusters of that state are the ones
+/// the shard state had after the same point
+/// @param exact state after every point before the shard, it goes on with the
+/// replayed points
+/// @param shard state of the shard after all of its points
+/// @param data pointer to the LAT value of the first point of the shard
+/// @param count number of points in the shard
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param open number of open clusters of the shard state after each point
+/// @param res cluster ids of the shard points in the shard state, the ids of
+/// the replayed points are replaced by their ids in `exact`
+/// @param continued result array of the id in `exact` of every cluster of the
+/// shard that is still open when the replay stops, -1 for the others
+/// @return the number of replayed points, `count` if the shard state never
+/// caught up
+unsigned int stitch_shard(clustering_state_t* exact, clustering_state_t* shard,
+                          double* data, unsigned int count,
+                          ptrdiff_t row_stride, ptrdiff_t col_stride,
+                          unsigned int* open, int* res, int* continued);
+
+/// @brief check if every open cluster of a replay has the same tail as a
+/// cluster of the shard, so both states cluster the next points alike
+/// @param exact state of the replay
+/// @param pair shard cluster every cluster of `exact` is paired with by id, -1
+/// if none
+/// @param continued cluster of `exact` every shard cluster is paired with
+/// @param shared number of last points a cluster of `exact` shares with its
+/// pair, by id
+/// @param len number of points of every shard cluster so far
+/// @return boolean value indicating if the shard state caught up
+uint8_t shard_caught_up(clustering_state_t* exact, int* pair, int* continued,
+                        unsigned int* shared, unsigned int* len);
+
+/// @brief find the root of a global cluster id
+/// @param parent union find parents of the global cluster ids
+/// @param id global cluster id
+/// @return the id of the cluster the given cluster continues
+int find_root(int* parent, int id);
+
 /// @brief find the closest cluster that is valid according to the user defined
 /// thresholds
-/// @param data the datapoints
-/// @param height the number of datapoints in data
-/// @param clusters_array array of existing clusters
-/// @param cluster_len number of existing clusters
-/// @param index index of the element to find compatibbility with
-/// @param distance_threshold maximum distance between cluster and new element
-/// @param time_threshold maximum time gap between cluster and new element
-/// @param angle_diff_threshold maximum angle difference between cluster and
-/// new element
-/// @param speed_diff_threshold maximum speed difference cluster and new element
-/// @param window_size number of elements from the end of the cluster to refer
-/// to
-/// @return the index of the most compatible cluster, -1 if none are compatible
-int find_closest_compatible_cluster(
-    double** data, unsigned int height, cluster_t* clusters_array,
-    unsigned int cluster_len, unsigned int index, double distance_threshold,
-    double time_threshold, double angle_diff_threshold,
-    double speed_diff_threshold, unsigned int window_size);
+/// @param state clustering state holding the open clusters and thresholds
+/// @param point the element to find compatibbility with
+/// @return the slot of the most compatible open cluster, -1 if none are
+/// compatible
+int find_closest_compatible_cluster(clustering_state_t* state, double* point);
+
+/// @brief get the grid and the gates ready to evaluate the open clusters for
+/// the point in `point_unit`
+/// @param state clustering state
+/// @param point the element the clusters are evaluated for
+/// @param gate gates of the point to fill
+void prepare_search(clustering_state_t* state, double* point, gate_t* gate);
+
+/// @brief put every open cluster in a new grid, with the motion gate in the
+/// cell of its position moved to `epoch`
+/// @param state clustering state
+/// @param epoch epoch the clusters are moved to
+void rebuild_grid(clustering_state_t* state, double epoch);
+
+/// @brief get the grid cell of a cluster, the cell of its last point or with
+/// the motion gate of its last point moved to `grid_epoch`
+/// @param state clustering state
+/// @param slot slot of the cluster, after its tail table row was updated
+/// @return pointer to the three cell coordinates, valid until the next call
+int32_t* cluster_cell(clustering_state_t* state, int slot);
+
+/// @brief collect the open clusters that can be compatible with the point
+/// being clustered
+/// @param state clustering state
+/// @param candidates pointer to the array of candidate slots
+/// @return the number of candidates
+unsigned int collect_candidates(clustering_state_t* state, int** candidates);
+
+/// @brief find the closest compatible candidate, splitting the candidates
+/// between the threads of the state when there are enough of them
+/// @param state clustering state
+/// @param candidates array of candidate slots
+/// @param count number of candidates
+/// @param point the element to find compatibbility with
+/// @param gate thresholds of the gates
+/// @return the slot of the closest compatible candidate, -1 if none are
+/// compatible
+int reduce_candidates(clustering_state_t* state, int* candidates,
+                      unsigned int count, double* point, gate_t* gate);
+
+/// @brief count the candidates of a point and the gates that rejected them
+/// in the stats of the state
+/// @param state clustering state, after the candidates were evaluated
+/// @param candidates array of candidate slots
+/// @param count number of candidates
+/// @param point the element the candidates were evaluated for
+/// @param gate gates the candidates were evaluated with
+void record_candidates(clustering_state_t* state, int* candidates,
+                       unsigned int count, double* point, gate_t* gate);
+
+/// @brief evaluate a range of candidates and find the closest compatible one
+/// @param state clustering state
+/// @param candidates array of candidate slots
+/// @param start first candidate of the range
+/// @param end end of the range
+/// @param point the element to find compatibbility with
+/// @param gate thresholds of the gates
+/// @param min_value pointer to the score of the closest candidate
+/// @return the slot of the closest compatible candidate, -1 if none are
+/// compatible
+int closest_candidate(clustering_state_t* state, int* candidates,
+                      unsigned int start, unsigned int end, double* point,
+                      gate_t* gate, double* min_value);
+
+/// @brief keep a candidate if it is closer than the closest one so far, the
+/// order is total so the result does not depend on how the candidates were
+/// split between threads
+/// @param state clustering state
+/// @param slot slot of the candidate
+/// @param value score of the candidate
+/// @param min_index pointer to the slot of the closest candidate so far
+/// @param min_value pointer to the score of the closest candidate so far
+void consider_candidate(clustering_state_t* state, int slot, double value,
+                        int* min_index, double* min_value);
+
+/// @brief copy what the compatibility kernel needs from a cluster to the tail
+/// table
+/// @param state clustering state
+/// @param slot slot of the cluster that changed
+void update_tail_table(clustering_state_t* state, int slot);
 
 /// @brief general function to calculate diference from window of cluster to new
 /// point
-/// @param data data points
 /// @param first existing cluster
 /// @param second new contendor
 /// @param window_size number of element to check back on
 /// @param diff_func function to calc the difference
+/// @param general_diff difference between the means of the two window halves
 /// @param threshold value to return if cluster is small
 /// @return
-double calc_diff(double** data, cluster_t first, unsigned int second,
-                 unsigned int window_size,
-                 double (*diff_func)(double*, double*), double threshold);
+double calc_diff(cluster_t* first, double* second, unsigned int window_size,
+                 double (*diff_func)(double*, double*), double general_diff,
+                 double threshold);
 
-/// @brief get the mean plot of range in cluster
-/// @param data data points
+/// @brief get the sum plot of range in the tail of a cluster
+/// @param state clustering state
 /// @param cluster cluster to run on
-/// @param res_mean mean plot
-/// @param start begining of range
-/// @param end end of range
-void mean_between(double** data, cluster_t cluster, double* res_mean,
-                  unsigned int start, unsigned int end);
+/// @param res_sum sum plot
+/// @param start begining of range, counted from the oldest point in the tail
+/// @param end end of range, counted from the oldest point in the tail
+void sum_between(clustering_state_t* state, cluster_t* cluster,
+                 double* res_sum, unsigned int start, unsigned int end);
+
+/// @brief update the running window sums of a cluster after a point was
+/// appended to its tail and cache the half window mean and general diffs
+/// @param state clustering state
+/// @param cluster cluster that grew
+/// @param leaving the point that left the window, NULL if the window was not
+/// full before the append
+void update_window(clustering_state_t* state, cluster_t* cluster,
+                   double* leaving);
 
 /// @brief calc speed diff on a moving mean window
-/// @param data data points
 /// @param first existing cluster to perform window function on
 /// @param second new contender point
 /// @param window_size the number of data points from the end to run over
 /// @param speed_diff_threshold value to return if cluster is small
 /// @return the speed diff
-double calc_speed_diff(double** data, cluster_t first, unsigned int second,
-                       unsigned int window_size, double speed_diff_threshold);
\ No newline at end of file
+double calc_speed_diff(cluster_t* first, double* second,
+                       unsigned int window_size, double speed_diff_threshold);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,348 @@
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agglomerative.h"
+
+#define SCENE_LAT 0.5585
+#define SCENE_LON 0.5934
+#define SCENE_EPOCH 1.6716e9
+
+typedef struct scene_params_s {
+  // number of points of the scene, the projectiles are added until it is
+  // reached
+  unsigned int points;
+  // seconds a projectile is tracked
+  double track_duration;
+  // seconds over which the projectiles start
+  double duration;
+  // plots per second of every projectile
+  double rate;
+  // standard deviation of the position error in meters
+  double noise;
+  // side of the square the projectiles start in, in meters
+  double area;
+  // fraction of the projectiles that fly through the center of the scene
+  double crossing;
+  uint64_t seed;
+} scene_params_t;
+
+typedef struct bench_params_s {
+  double distance_threshold;
+  double time_threshold;
+  double angle_diff_threshold;
+  double speed_diff_threshold;
+  unsigned int window_size;
+  unsigned int repeats;
+} bench_params_t;
+
+static uint64_t rng_state;
+
+static double uniform(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normal(void) {
+  return sqrt(-2 * log(uniform() + 1e-300)) * cos(2 * PI * uniform());
+}
+
+static int compare_epoch(const void *first, const void *second) {
+  double first_epoch = ((const double *)first)[EPOCH];
+  double second_epoch = ((const double *)second)[EPOCH];
+
+  return (first_epoch > second_epoch) - (first_epoch < second_epoch);
+}
+
+static double now(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// json has no infinity, an unbounded threshold is written as null
+static const char *json_number(char *buffer, double value) {
+  if (!isfinite(value)) {
+    return "null";
+  }
+
+  snprintf(buffer, 32, "%.17g", value);
+  return buffer;
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/// @brief generate an epoch sorted scene of straight, climbing projectiles
+/// with noisy and occasionally missing plots
+/// @param params scene parameters
+/// @param tracks pointer to the number of generated projectiles
+/// @return row major array of `params->points` points
+static double *generate_scene(scene_params_t *params, unsigned int *tracks) {
+  double(*points)[WIDTH] =
+      (double(*)[WIDTH])malloc(sizeof(double[WIDTH]) * params->points);
+  unsigned int len = 0;
+  double meters_to_lat = 1.0 / R;
+  double meters_to_lon = 1.0 / (R * cos(SCENE_LAT));
+
+  rng_state = params->seed * 2654435761u + 88172645463325252ull;
+  *tracks = 0;
+
+  while (len < params->points) {
+    double speed = 50 + uniform() * 500;
+    double heading = uniform() * 2 * PI;
+    double climb = (uniform() - 0.5) * 40;
+    double start = uniform() * params->duration;
+    double north = (uniform() - 0.5) * params->area;
+    double east = (uniform() - 0.5) * params->area;
+    double alt = uniform() * 3000;
+
+    // a crossing projectile is half way through its track at the center
+    if (uniform() < params->crossing) {
+      double half = speed * params->track_duration / 2;
+
+      north = -half * cos(heading);
+      east = -half * sin(heading);
+    }
+
+    (*tracks)++;
+
+    for (double t = 0; t < params->track_duration && len < params->points;
+         t += (0.8 + 0.4 * uniform()) / params->rate) {
+      // some plots are missed by the sensor
+      if (uniform() < 0.05) {
+        continue;
+      }
+
+      double *point = points[len++];
+      point[LAT] = SCENE_LAT +
+                   (north + speed * t * cos(heading) + normal() * params->noise) *
+                       meters_to_lat;
+      point[LON] = SCENE_LON +
+                   (east + speed * t * sin(heading) + normal() * params->noise) *
+                       meters_to_lon;
+      point[ALT] = alt + climb * t + normal() * params->noise;
+      point[EPOCH] = SCENE_EPOCH + start + t;
+    }
+  }
+
+  qsort(points, len, sizeof(double[WIDTH]), compare_epoch);
+
+  return (double *)points;
+}
+
+/// @brief generate one scene and time its clustering, meant to run in its own
+/// process so the peak rss is the one of this scale
+static void run_scale(FILE *out, scene_params_t *scene, bench_params_t *bench) {
+  unsigned int tracks;
+  double generate_start = now();
+  double *points = generate_scene(scene, &tracks);
+  double generate_seconds = now() - generate_start;
+  double **data = (double **)malloc(sizeof(double *) * scene->points);
+  int *res = (int *)malloc(sizeof(int) * scene->points);
+  double best = INFINITY;
+  double total = 0;
+
+  for (unsigned int i = 0; i < scene->points; i++) {
+    data[i] = points + (size_t)i * WIDTH;
+  }
+
+  long scene_rss = peak_rss_kb();
+
+  for (unsigned int i = 0; i < bench->repeats; i++) {
+    double start = now();
+    agglomerative_clustering(data, scene->points, bench->distance_threshold,
+                             bench->time_threshold, bench->angle_diff_threshold,
+                             bench->speed_diff_threshold, bench->window_size,
+                             res);
+    double seconds = now() - start;
+
+    total += seconds;
+    best = seconds < best ? seconds : best;
+  }
+
+  int clusters = 0;
+  char thresholds[4][32];
+
+  for (unsigned int i = 0; i < scene->points; i++) {
+    clusters = res[i] + 1 > clusters ? res[i] + 1 : clusters;
+  }
+
+  fprintf(out,
+          "{\"points\": %u, \"tracks\": %u, \"clusters\": %d, "
+          "\"rate\": %g, \"noise\": %g, \"crossing\": %g, "
+          "\"track_duration\": %g, \"duration\": %g, \"area\": %g, "
+          "\"eps\": %s, \"time_eps\": %s, \"alpha\": %s, \"speed_eps\": %s, "
+          "\"window\": %u, \"repeats\": %u, \"generate_seconds\": %.6f, "
+          "\"best_seconds\": %.6f, \"mean_seconds\": %.6f, "
+          "\"points_per_second\": %.1f, \"ns_per_point\": %.2f, "
+          "\"scene_rss_kb\": %ld, \"peak_rss_kb\": %ld}\n",
+          scene->points, tracks, clusters, scene->rate, scene->noise,
+          scene->crossing, scene->track_duration, scene->duration, scene->area,
+          json_number(thresholds[0], bench->distance_threshold),
+          json_number(thresholds[1], bench->time_threshold),
+          json_number(thresholds[2], bench->angle_diff_threshold),
+          json_number(thresholds[3], bench->speed_diff_threshold),
+          bench->window_size, bench->repeats, generate_seconds, best,
+          total / bench->repeats, scene->points / best,
+          best * 1e9 / scene->points, scene_rss, peak_rss_kb());
+  fflush(out);
+
+  free(res);
+  free(data);
+  free(points);
+}
+
+static void usage(char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n MIN      smallest scale in points (1000)\n"
+          "  -N MAX      largest scale in points (10000000)\n"
+          "  -f FACTOR   growth of the scale between runs (10)\n"
+          "  -r RATE     plots per second of a projectile (1)\n"
+          "  -T SECONDS  seconds a projectile is tracked (300)\n"
+          "  -d SECONDS  seconds the projectiles start over, 0 to grow it with\n"
+          "              the scale so the concurrent projectiles stay constant "
+          "(0)\n"
+          "  -c COUNT    concurrent projectiles when -d is 0 (200)\n"
+          "  -e METERS   sensor noise (10)\n"
+          "  -a METERS   side of the start area (100000)\n"
+          "  -x FRACTION projectiles crossing the center of the scene (0.2)\n"
+          "  -s SEED     generator seed (1)\n"
+          "  -R REPEATS  timed runs of every scale (3)\n"
+          "  -E EPS -t TIME_EPS -A ALPHA -S SPEED_EPS -w WINDOW\n"
+          "              clustering parameters (1000 10 20 inf 10)\n"
+          "  -o FILE     write the results there instead of stdout\n"
+          "every scale is written as one json line\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  scene_params_t scene = {0, 300, 0, 1, 10, 100000, 0.2, 1};
+  bench_params_t bench = {1000, 10, 20, INFINITY, 10, 3};
+  double min_points = 1e3;
+  double max_points = 1e7;
+  double factor = 10;
+  double concurrent = 200;
+  double duration = 0;
+  FILE *out = stdout;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:N:f:r:T:d:c:e:a:x:s:R:E:t:A:S:w:o:h")) !=
+         -1) {
+    switch (option) {
+      case 'n':
+        min_points = atof(optarg);
+        break;
+      case 'N':
+        max_points = atof(optarg);
+        break;
+      case 'f':
+        factor = atof(optarg);
+        break;
+      case 'r':
+        scene.rate = atof(optarg);
+        break;
+      case 'T':
+        scene.track_duration = atof(optarg);
+        break;
+      case 'd':
+        duration = atof(optarg);
+        break;
+      case 'c':
+        concurrent = atof(optarg);
+        break;
+      case 'e':
+        scene.noise = atof(optarg);
+        break;
+      case 'a':
+        scene.area = atof(optarg);
+        break;
+      case 'x':
+        scene.crossing = atof(optarg);
+        break;
+      case 's':
+        scene.seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'R':
+        bench.repeats = (unsigned int)atoi(optarg);
+        break;
+      case 'E':
+        bench.distance_threshold = atof(optarg);
+        break;
+      case 't':
+        bench.time_threshold = atof(optarg);
+        break;
+      case 'A':
+        bench.angle_diff_threshold = atof(optarg);
+        break;
+      case 'S':
+        bench.speed_diff_threshold = atof(optarg);
+        break;
+      case 'w':
+        bench.window_size = (unsigned int)atoi(optarg);
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+
+        if (out == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!(factor > 1) || !(min_points >= 1) || bench.repeats == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (double points = min_points; points <= max_points * (1 + 1e-9);
+       points *= factor) {
+    scene.points = (unsigned int)points;
+    scene.duration = duration;
+
+    // keep about `concurrent` projectiles in the air at every scale
+    if (duration <= 0) {
+      scene.duration = fmax(scene.points / (scene.rate * concurrent) -
+                                scene.track_duration,
+                            0);
+    }
+
+    // every scale runs in its own process so its peak rss is not hidden by
+    // the larger scales before it
+    fflush(out);
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      run_scale(out, &scene, &bench);
+      _exit(0);
+    }
+
+    int status = 1;
+
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+      fprintf(stderr, "scale of %u points failed\n", scene.points);
+      return 1;
+    }
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  return 0;
+}
@@ -0,0 +1,553 @@
+#include "csv_loader.h"
+
+// find the end of the line at `cursor` and the start of the next one, a
+// carriage return before the newline is not part of the line
+static const uint8_t *next_line(const uint8_t *cursor, const uint8_t *end,
+                                const uint8_t **stop) {
+  const uint8_t *newline =
+      (const uint8_t *)memchr(cursor, '\n', (size_t)(end - cursor));
+
+  if (newline == NULL) {
+    newline = end;
+  }
+
+  *stop = newline > cursor && newline[-1] == '\r' ? newline - 1 : newline;
+
+  return newline == end ? end : newline + 1;
+}
+
+// count the records and the lines of a chunk, the empty lines hold no record
+static void count_chunk(const uint8_t *cursor, const uint8_t *end,
+                        size_t *rows, size_t *lines) {
+  const uint8_t *stop;
+
+  *rows = 0;
+  *lines = 0;
+
+  while (cursor < end) {
+    const uint8_t *line = cursor;
+
+    cursor = next_line(cursor, end, &stop);
+    *rows += stop > line;
+    *lines += 1;
+  }
+}
+
+static uint8_t parse_record(csv_reader_t *reader, const uint8_t *cursor,
+                            const uint8_t *end, double *point) {
+  char field[CSV_LOADER_FIELD];
+  size_t length;
+
+  for (unsigned int k = 0; k < reader->fields; k++) {
+    uint8_t wanted = FALSE;
+
+    // a line that ends early is missing the fields after it
+    if (k > 0 && cursor == end) {
+      return FALSE;
+    }
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      wanted |= reader->column_field[j] == k;
+    }
+
+    cursor = read_csv_field(cursor, end, wanted ? field : NULL, sizeof(field),
+                            &length);
+
+    if (!wanted) {
+      continue;
+    }
+
+    if (length >= sizeof(field)) {
+      return FALSE;
+    }
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      if (reader->column_field[j] == k &&
+          !(j == EPOCH ? parse_timestamp(field, &point[j])
+                       : parse_csv_number(field, &point[j]))) {
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+// parse the records of a chunk into their rows
+// returns the line of the file of the first record that could not be parsed,
+// 0 when all of them were
+static size_t read_chunk(csv_reader_t *reader, unsigned int chunk,
+                         double *data, ptrdiff_t row_stride,
+                         ptrdiff_t col_stride, uint8_t cast_to_radians) {
+  const uint8_t *cursor = reader->file.data + reader->chunk_begin[chunk];
+  const uint8_t *end = reader->file.data + reader->chunk_begin[chunk + 1];
+  const uint8_t *stop;
+  unsigned int row = reader->chunk_row[chunk];
+  size_t line = reader->chunk_line[chunk];
+  double point[WIDTH];
+
+  while (cursor < end) {
+    const uint8_t *record = cursor;
+
+    cursor = next_line(cursor, end, &stop);
+    line++;
+
+    if (stop == record) {
+      continue;
+    }
+
+    // the header is the first line of the file
+    if (!parse_record(reader, record, stop, point)) {
+      return line + 1;
+    }
+
+    // same factor as `np.deg2rad`, so the points match the ones `fit` reads
+    if (cast_to_radians) {
+      point[LAT] *= M_PI / 180;
+      point[LON] *= M_PI / 180;
+    }
+
+    double *res = data + (ptrdiff_t)row * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      res[(ptrdiff_t)j * col_stride] = point[j];
+    }
+
+    row++;
+  }
+
+  return 0;
+}
+
+csv_reader_t *csv_reader_open(const char *path, const char *lat_col,
+                              const char *lon_col, const char *alt_col,
+                              const char *timestamp_col, int threads,
+                              int *error) {
+  const char *names[WIDTH] = {lat_col, lon_col, alt_col, timestamp_col};
+  int column_field[WIDTH] = {-1, -1, -1, -1};
+  csv_reader_t *reader = (csv_reader_t *)calloc(1, sizeof(csv_reader_t));
+
+  if (reader == NULL) {
+    *error = CSV_LOADER_MEMORY;
+    return NULL;
+  }
+
+  if (!map_file(&reader->file, path, 0, FALSE)) {
+    free(reader);
+    *error = CSV_LOADER_IO;
+    return NULL;
+  }
+
+#ifdef _OPENMP
+  if (threads <= 0) {
+    threads = omp_get_max_threads();
+  }
+#else
+  threads = 1;
+#endif
+
+  reader->threads = threads;
+
+  // an empty file has no header line to find the columns in
+  if (reader->file.size == 0) {
+    csv_reader_close(reader);
+    *error = CSV_LOADER_COLUMN;
+    return NULL;
+  }
+
+  const uint8_t *begin = reader->file.data;
+  const uint8_t *end = begin + reader->file.size;
+  const uint8_t *header_end;
+  char name[256];
+  size_t length;
+
+  // a byte order mark in front of the header is not part of the first name
+  if (reader->file.size >= 3 && memcmp(begin, "\xef\xbb\xbf", 3) == 0) {
+    begin += 3;
+  }
+
+  const uint8_t *records = next_line(begin, end, &header_end);
+
+  for (int k = 0; begin < header_end; k++) {
+    begin = read_csv_field(begin, header_end, name, sizeof(name), &length);
+
+    // the first of columns with the same name is read
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      if (column_field[j] == -1 && length < sizeof(name) &&
+          strcmp(name, names[j]) == 0) {
+        column_field[j] = k;
+      }
+    }
+  }
+
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    if (column_field[j] == -1) {
+      csv_reader_close(reader);
+      *error = CSV_LOADER_COLUMN;
+      return NULL;
+    }
+
+    reader->column_field[j] = (unsigned int)column_field[j];
+    reader->fields = reader->fields > reader->column_field[j] + 1
+                         ? reader->fields
+                         : reader->column_field[j] + 1;
+  }
+
+  // a chunk per thread unless the chunks would be too small to pay for one
+  size_t bytes = (size_t)(end - records);
+  size_t chunks = bytes / CSV_LOADER_CHUNK + 1;
+
+  reader->chunks = chunks < (size_t)threads ? (unsigned int)chunks
+                                             : (unsigned int)threads;
+  reader->chunk_begin =
+      (size_t *)malloc(sizeof(size_t) * (reader->chunks + 1));
+  reader->chunk_row =
+      (unsigned int *)malloc(sizeof(unsigned int) * (reader->chunks + 1));
+  reader->chunk_line = (size_t *)malloc(sizeof(size_t) * (reader->chunks + 1));
+  size_t *rows = (size_t *)malloc(sizeof(size_t) * reader->chunks);
+
+  if (reader->chunk_begin == NULL || reader->chunk_row == NULL ||
+      reader->chunk_line == NULL || rows == NULL) {
+    free(rows);
+    csv_reader_close(reader);
+    *error = CSV_LOADER_MEMORY;
+    return NULL;
+  }
+
+  // every chunk starts at the first line after its share of the bytes
+  reader->chunk_begin[0] = (size_t)(records - reader->file.data);
+  reader->chunk_begin[reader->chunks] = reader->file.size;
+
+  for (unsigned int i = 1; i < reader->chunks; i++) {
+    const uint8_t *cursor = records + bytes / reader->chunks * i;
+    const uint8_t *stop;
+
+    if (cursor[-1] != '\n') {
+      cursor = next_line(cursor, end, &stop);
+    }
+
+    reader->chunk_begin[i] = (size_t)(cursor - reader->file.data);
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif
+  for (int i = 0; i < (int)reader->chunks; i++) {
+    count_chunk(reader->file.data + reader->chunk_begin[i],
+                reader->file.data + reader->chunk_begin[i + 1], &rows[i],
+                &reader->chunk_line[i + 1]);
+  }
+
+  size_t total = 0;
+
+  reader->chunk_row[0] = 0;
+  reader->chunk_line[0] = 0;
+
+  for (unsigned int i = 0; i < reader->chunks; i++) {
+    total += rows[i];
+    reader->chunk_row[i + 1] = (unsigned int)total;
+    reader->chunk_line[i + 1] += reader->chunk_line[i];
+  }
+
+  free(rows);
+
+  // the rows are counted in unsigned ints like the points of the clustering
+  if (total > UINT_MAX) {
+    csv_reader_close(reader);
+    *error = CSV_LOADER_FORMAT;
+    return NULL;
+  }
+
+  reader->rows = (unsigned int)total;
+  *error = CSV_LOADER_OK;
+
+  return reader;
+}
+
+unsigned int csv_reader_rows(csv_reader_t *reader) { return reader->rows; }
+
+int csv_reader_read(csv_reader_t *reader, double *data, ptrdiff_t row_stride,
+                    ptrdiff_t col_stride, uint8_t cast_to_radians) {
+  size_t *errors = (size_t *)malloc(sizeof(size_t) * reader->chunks);
+
+  if (errors == NULL) {
+    return CSV_LOADER_MEMORY;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(reader->threads) schedule(static, 1)
+#endif
+  for (int i = 0; i < (int)reader->chunks; i++) {
+    errors[i] = read_chunk(reader, (unsigned int)i, data, row_stride,
+                           col_stride, cast_to_radians);
+  }
+
+  // the chunks are in file order, so the first error is the earliest line
+  reader->error_line = 0;
+
+  for (unsigned int i = 0; i < reader->chunks && reader->error_line == 0;
+       i++) {
+    reader->error_line = errors[i];
+  }
+
+  free(errors);
+
+  return reader->error_line == 0 ? CSV_LOADER_OK : CSV_LOADER_FORMAT;
+}
+
+size_t csv_reader_error_line(csv_reader_t *reader) {
+  return reader->error_line;
+}
+
+void csv_reader_close(csv_reader_t *reader) {
+  if (reader == NULL) {
+    return;
+  }
+
+  unmap_file(&reader->file);
+  free(reader->chunk_begin);
+  free(reader->chunk_row);
+  free(reader->chunk_line);
+  free(reader);
+}
+
+const uint8_t *read_csv_field(const uint8_t *cursor, const uint8_t *end,
+                              char *field, size_t capacity, size_t *length) {
+  size_t len = 0;
+
+  while (cursor < end && (*cursor == ' ' || *cursor == '\t')) {
+    cursor++;
+  }
+
+  if (cursor < end && *cursor == '"') {
+    cursor++;
+
+    while (cursor < end) {
+      if (*cursor == '"') {
+        cursor++;
+
+        if (cursor == end || *cursor != '"') {
+          break;
+        }
+      }
+
+      if (field != NULL && len + 1 < capacity) {
+        field[len] = (char)*cursor;
+      }
+
+      len++;
+      cursor++;
+    }
+
+    // anything between the closing quote and the comma is dropped
+    while (cursor < end && *cursor != ',') {
+      cursor++;
+    }
+  } else {
+    size_t kept = 0;
+
+    while (cursor < end && *cursor != ',') {
+      if (field != NULL && len + 1 < capacity) {
+        field[len] = (char)*cursor;
+      }
+
+      len++;
+
+      if (*cursor != ' ' && *cursor != '\t') {
+        kept = len;
+      }
+
+      cursor++;
+    }
+
+    len = kept;
+  }
+
+  if (field != NULL) {
+    field[len < capacity ? len : capacity - 1] = '\0';
+  }
+
+  *length = len;
+
+  return cursor < end ? cursor + 1 : end;
+}
+
+uint8_t parse_csv_number(const char *field, double *value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *cursor = field + (*field == '-' || *field == '+');
+  uint64_t mantissa = 0;
+  unsigned int digits = 0;
+  int scale = -1;
+  char *parsed;
+
+  // a plain decimal whose digits fit the mantissa of a double is the quotient
+  // of two exact doubles, so one division rounds it like `strtod` does
+  for (; digits < 19; cursor++) {
+    if (*cursor >= '0' && *cursor <= '9') {
+      mantissa = mantissa * 10 + (uint64_t)(*cursor - '0');
+      digits++;
+      scale += scale >= 0;
+    } else if (*cursor == '.' && scale == -1) {
+      scale = 0;
+    } else {
+      break;
+    }
+  }
+
+  if (*cursor == '\0' && digits > 0 && mantissa <= (1ull << 53)) {
+    *value = (double)mantissa / powers[scale > 0 ? scale : 0];
+    *value = *field == '-' ? -*value : *value;
+    return TRUE;
+  }
+
+  *value = strtod(field, &parsed);
+
+  if (parsed == field) {
+    return FALSE;
+  }
+
+  while (*parsed == ' ' || *parsed == '\t') {
+    parsed++;
+  }
+
+  return *parsed == '\0';
+}
+
+// read exactly `count` digits
+static uint8_t read_digits(const char **cursor, unsigned int count,
+                           unsigned int *value) {
+  *value = 0;
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (**cursor < '0' || **cursor > '9') {
+      return FALSE;
+    }
+
+    *value = *value * 10 + (unsigned int)(**cursor - '0');
+    (*cursor)++;
+  }
+
+  return TRUE;
+}
+
+uint8_t parse_timestamp(const char *field, double *epoch) {
+  const char *cursor = field;
+  unsigned int year, month, day, hour = 0, minute = 0, second = 0;
+  double fraction = 0;
+  int64_t offset = 0;
+
+  if (!read_digits(&cursor, 4, &year) || *cursor != '-') {
+    return parse_csv_number(field, epoch);
+  }
+
+  cursor++;
+
+  if (!read_digits(&cursor, 2, &month) || *cursor++ != '-' ||
+      !read_digits(&cursor, 2, &day)) {
+    return FALSE;
+  }
+
+  if (*cursor == 'T' || *cursor == ' ') {
+    cursor++;
+
+    if (!read_digits(&cursor, 2, &hour) || *cursor++ != ':' ||
+        !read_digits(&cursor, 2, &minute)) {
+      return FALSE;
+    }
+
+    if (*cursor == ':') {
+      cursor++;
+
+      if (!read_digits(&cursor, 2, &second)) {
+        return FALSE;
+      }
+
+      if (*cursor == '.' || *cursor == ',') {
+        // the fraction is parsed as a decimal of its own so it is rounded once
+        // like the seconds pandas gives
+        char digits[CSV_LOADER_FIELD] = "0.";
+        size_t len = 2;
+
+        cursor++;
+
+        while (*cursor >= '0' && *cursor <= '9' && len + 1 < sizeof(digits)) {
+          digits[len++] = *cursor++;
+        }
+
+        if (len == 2) {
+          return FALSE;
+        }
+
+        digits[len] = '\0';
+        parse_csv_number(digits, &fraction);
+      }
+    }
+
+    if (*cursor == 'Z') {
+      cursor++;
+    } else if (*cursor == '+' || *cursor == '-') {
+      int64_t sign = *cursor++ == '-' ? -1 : 1;
+      unsigned int offset_hours, offset_minutes = 0;
+
+      if (!read_digits(&cursor, 2, &offset_hours)) {
+        return FALSE;
+      }
+
+      // the minutes of the offset are optional, with or without a colon
+      if (*cursor == ':') {
+        cursor++;
+
+        if (!read_digits(&cursor, 2, &offset_minutes)) {
+          return FALSE;
+        }
+      } else if (*cursor >= '0' && *cursor <= '9' &&
+                 !read_digits(&cursor, 2, &offset_minutes)) {
+        return FALSE;
+      }
+
+      offset = sign * (int64_t)(offset_hours * 3600 + offset_minutes * 60);
+    }
+  }
+
+  while (*cursor == ' ' || *cursor == '\t') {
+    cursor++;
+  }
+
+  // a leap second is rejected like pandas does, it has no epoch of its own
+  if (*cursor != '\0' || month < 1 || month > 12 || day < 1 ||
+      day > days_in_month(year, month) || hour > 23 || minute > 59 ||
+      second > 59) {
+    return FALSE;
+  }
+
+  *epoch = (double)(days_from_civil(year, month, day) * 86400 + hour * 3600 +
+                    minute * 60 + second - offset) +
+           fraction;
+
+  return TRUE;
+}
+
+unsigned int days_in_month(int64_t year, unsigned int month) {
+  static const unsigned int days[12] = {31, 28, 31, 30, 31, 30,
+                                        31, 31, 30, 31, 30, 31};
+  uint8_t leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+
+  return days[month - 1] + (month == 2 && leap);
+}
+
+int64_t days_from_civil(int64_t year, unsigned int month, unsigned int day) {
+  // the years start in march so the leap day is the last day of a year
+  year -= month <= 2;
+
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+                        day - 1;
+  int64_t day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+  return era * 146097 + day_of_era - 719468;
+}
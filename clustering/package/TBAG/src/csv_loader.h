@@ -0,0 +1,132 @@
+#ifndef CSV_LOADER_H
+#define CSV_LOADER_H
+
+#include "trajectory_file.h"
+
+// bytes of records below which a file is not split between more threads
+#define CSV_LOADER_CHUNK (1u << 20)
+// longest lat, lon, alt or timestamp field that is parsed, with its NUL
+#define CSV_LOADER_FIELD 64
+
+enum csv_loader_error {
+  CSV_LOADER_OK = 0,
+  // the file could not be opened or mapped
+  CSV_LOADER_IO = -1,
+  // one of the columns is not in the header line
+  CSV_LOADER_COLUMN = -2,
+  // a field is missing or is not a number or a timestamp, the line is kept in
+  // `error_line`
+  CSV_LOADER_FORMAT = -3,
+  // the reader could not be allocated
+  CSV_LOADER_MEMORY = -4,
+};
+
+/// a mapped csv file with a header line and a record on every line, split
+/// into chunks that start at a line so every thread parses its own chunk and
+/// writes its rows straight into the result
+typedef struct csv_reader_s {
+  mapped_file_t file;
+  // field of the LAT, LON, ALT and EPOCH columns and the number of fields up
+  // to the last of them, the fields after it are skipped
+  unsigned int column_field[WIDTH];
+  unsigned int fields;
+  // chunk `i` is the bytes from `chunk_begin[i]` up to `chunk_begin[i + 1]`,
+  // its first record is row `chunk_row[i]` and its first line is line
+  // `chunk_line[i]` of the records
+  unsigned int chunks;
+  size_t* chunk_begin;
+  unsigned int* chunk_row;
+  size_t* chunk_line;
+  // number of records, empty lines are skipped
+  unsigned int rows;
+  int threads;
+  // line of the file of the first field that could not be parsed, 1 based
+  // with the header on line 1, 0 when every field was parsed
+  size_t error_line;
+} csv_reader_t;
+
+/// @brief map a csv file, find the columns in its header line and count its
+/// records in parallel
+/// @param path path of the csv file
+/// @param lat_col name of the latitude column
+/// @param lon_col name of the longitude column
+/// @param alt_col name of the altitude column
+/// @param timestamp_col name of the timestamp column, either ISO 8601
+/// timestamps or seconds since the epoch
+/// @param threads number of threads, 0 or less for one per core
+/// @param error pointer to one of `csv_loader_error`
+/// @return the reader, NULL when `error` is not `CSV_LOADER_OK`
+csv_reader_t* csv_reader_open(const char* path, const char* lat_col,
+                              const char* lon_col, const char* alt_col,
+                              const char* timestamp_col, int threads,
+                              int* error);
+
+/// @brief get the number of records of a csv file
+/// @param reader csv reader
+/// @return number of rows `csv_reader_read` writes
+unsigned int csv_reader_rows(csv_reader_t* reader);
+
+/// @brief parse the records of a csv file in parallel chunks into the layout
+/// the clustering reads, the timestamps are converted to seconds since the
+/// epoch
+/// @param reader csv reader
+/// @param data pointer to the LAT value of the first point, room for
+/// `csv_reader_rows` points
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param cast_to_radians TRUE to convert the lat and lon from degrees
+/// @return one of `csv_loader_error`
+int csv_reader_read(csv_reader_t* reader, double* data, ptrdiff_t row_stride,
+                    ptrdiff_t col_stride, uint8_t cast_to_radians);
+
+/// @brief get the line of the first field `csv_reader_read` could not parse
+/// @param reader csv reader
+/// @return line of the file, 1 based, 0 when every field was parsed
+size_t csv_reader_error_line(csv_reader_t* reader);
+
+/// @brief unmap a csv file and free its reader
+/// @param reader csv reader, can be NULL
+void csv_reader_close(csv_reader_t* reader);
+
+/// @brief split the next field off a line, a quoted field keeps its commas and
+/// reads `""` as a quote, the blanks around a field are trimmed
+/// @param cursor first byte of the field
+/// @param end end of the line
+/// @param field buffer for the field, NULL to skip it
+/// @param capacity size of the buffer
+/// @param length pointer to the length of the whole field, can be more than
+/// the buffer holds
+/// @return first byte of the next field, `end` after the last field
+const uint8_t* read_csv_field(const uint8_t* cursor, const uint8_t* end,
+                              char* field, size_t capacity, size_t* length);
+
+/// @brief parse a number that makes up a whole field
+/// @param field NUL terminated field
+/// @param value pointer to the number
+/// @return boolean value indicating if the field is a number
+uint8_t parse_csv_number(const char* field, double* value);
+
+/// @brief parse an ISO 8601 date or date and time like
+/// `2023-01-20 15:30:05.25`, `2023-01-20T15:30Z` or `2023-01-20T15:30:05+02:00`
+/// into seconds since the epoch, a time without an offset is UTC. a day past
+/// the end of its month or a leap second is not a timestamp, like in pandas. a
+/// field that does not start with a date is parsed as seconds since the epoch
+/// @param field NUL terminated field
+/// @param epoch pointer to the seconds since the epoch
+/// @return boolean value indicating if the field is a timestamp
+uint8_t parse_timestamp(const char* field, double* epoch);
+
+/// @brief count the days of a month of the proleptic gregorian calendar
+/// @param year year
+/// @param month month, 1 to 12
+/// @return number of days, 29 for february of a leap year
+unsigned int days_in_month(int64_t year, unsigned int month);
+
+/// @brief count the days of a proleptic gregorian date since 1970-01-01
+/// @param year year
+/// @param month month, 1 to 12
+/// @param day day of the month, 1 based
+/// @return number of days, negative before the epoch
+int64_t days_from_civil(int64_t year, unsigned int month, unsigned int day);
+
+#endif
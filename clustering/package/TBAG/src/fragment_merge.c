@@ -0,0 +1,344 @@
+#include "fragment_merge.h"
+
+static void load_point(double *data, unsigned int index, ptrdiff_t row_stride,
+                       ptrdiff_t col_stride, double *point) {
+  double *row = data + (ptrdiff_t)index * row_stride;
+
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    point[j] = row[(ptrdiff_t)j * col_stride];
+  }
+}
+
+unsigned int merge_fragments(double *data, unsigned int height,
+                             ptrdiff_t row_stride, ptrdiff_t col_stride,
+                             double distance_threshold,
+                             double angle_diff_threshold,
+                             double speed_diff_threshold,
+                             unsigned int window_size, double max_gap,
+                             int *res) {
+  unsigned int len;
+  fragment_t *fragments = collect_fragments(data, row_stride, col_stride, res,
+                                            height, window_size, &len);
+
+  if (fragments == NULL) {
+    return 0;
+  }
+
+  merge_heap_t heap = {NULL, 0, 0};
+  epoch_order_t *starts =
+      (epoch_order_t *)malloc(sizeof(epoch_order_t) * len);
+
+  // the ids follow the order the points were given, which is not the order
+  // of their start epochs once a pass takes points within its lateness
+  for (unsigned int i = 0; i < len; i++) {
+    starts[i].epoch = data[(ptrdiff_t)fragments[i].first * row_stride +
+                           EPOCH * col_stride];
+    starts[i].index = i;
+  }
+
+  qsort(starts, len, sizeof(epoch_order_t), compare_epoch_order);
+
+  for (unsigned int i = 0; i < len; i++) {
+    double end = data[(ptrdiff_t)fragments[i].last * row_stride +
+                      EPOCH * col_stride];
+    unsigned int low = 0;
+    unsigned int high = len;
+
+    // the first fragment that starts after this one ends
+    while (low < high) {
+      unsigned int middle = low + (high - low) / 2;
+
+      if (starts[middle].epoch > end) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+
+    for (unsigned int j = low; j < len && starts[j].epoch - end <= max_gap;
+         j++) {
+      merge_candidate_t candidate = {0, (int)i, (int)starts[j].index};
+
+      if (check_fragments(data, row_stride, col_stride, &fragments[i],
+                          &fragments[starts[j].index], distance_threshold,
+                          angle_diff_threshold, speed_diff_threshold,
+                          &candidate.score)) {
+        merge_heap_push(&heap, candidate);
+      }
+    }
+  }
+
+  unsigned int merges = 0;
+
+  while (heap.len > 0) {
+    merge_candidate_t candidate = merge_heap_pop(&heap);
+
+    if (fragments[candidate.first].next != -1 ||
+        fragments[candidate.second].prev != -1) {
+      continue;
+    }
+
+    fragments[candidate.first].next = candidate.second;
+    fragments[candidate.second].prev = candidate.first;
+    merges++;
+  }
+
+  // a fragment only continues one that started before it, so in start order
+  // the head of its chain is known first
+  int *heads = (int *)malloc(sizeof(int) * len);
+  int *labels = (int *)malloc(sizeof(int) * len);
+  int next_label = 0;
+
+  for (unsigned int i = 0; i < len; i++) {
+    unsigned int fragment = starts[i].index;
+
+    heads[fragment] = fragments[fragment].prev == -1
+                          ? (int)fragment
+                          : heads[fragments[fragment].prev];
+    labels[fragment] = -1;
+  }
+
+  // the merged ids are given in order of first appearance, like the ids of a
+  // pass
+  for (unsigned int i = 0; i < height; i++) {
+    if (res[i] == -1) {
+      continue;
+    }
+
+    int head = heads[res[i]];
+
+    if (labels[head] == -1) {
+      labels[head] = next_label++;
+    }
+
+    res[i] = labels[head];
+  }
+
+  free(labels);
+  free(heads);
+  free(heap.items);
+  free(starts);
+  free(fragments);
+
+  return merges;
+}
+
+fragment_t *collect_fragments(double *data, ptrdiff_t row_stride,
+                              ptrdiff_t col_stride, int *res,
+                              unsigned int height, unsigned int window_size,
+                              unsigned int *len) {
+  int clusters = 0;
+  unsigned int points = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    clusters = res[i] + 1 > clusters ? res[i] + 1 : clusters;
+  }
+
+  *len = (unsigned int)clusters;
+
+  if (clusters == 0) {
+    return NULL;
+  }
+
+  fragment_t *fragments =
+      (fragment_t *)calloc((size_t)clusters, sizeof(fragment_t));
+  unsigned int *seen = (unsigned int *)calloc((size_t)clusters,
+                                              sizeof(unsigned int));
+  epoch_order_t *order =
+      (epoch_order_t *)malloc(sizeof(epoch_order_t) * height);
+  unsigned int window = window_size > 1 ? window_size : 1;
+
+  // the points without a cluster, like the late points of
+  // `agglomerative_clustering_unordered`, are not part of any fragment. the
+  // others are taken by epoch, the points of an unordered pass are only
+  // roughly sorted
+  for (unsigned int i = 0; i < height; i++) {
+    if (res[i] == -1) {
+      continue;
+    }
+
+    order[points].epoch = data[(ptrdiff_t)i * row_stride + EPOCH * col_stride];
+    order[points].index = i;
+    points++;
+  }
+
+  qsort(order, points, sizeof(epoch_order_t), compare_epoch_order);
+
+  for (unsigned int i = 0; i < points; i++) {
+    unsigned int index = order[i].index;
+    fragment_t *fragment = &fragments[res[index]];
+
+    if (fragment->len == 0) {
+      fragment->first = index;
+    }
+
+    fragment->len++;
+    fragment->last = index;
+  }
+
+  for (unsigned int i = 0; i < points; i++) {
+    unsigned int index = order[i].index;
+    fragment_t *fragment = &fragments[res[index]];
+    unsigned int position = seen[res[index]]++;
+    unsigned int fragment_window =
+        fragment->len < window ? fragment->len : window;
+
+    if (position + 1 == fragment_window) {
+      fragment->head_end = index;
+    }
+
+    if (position == fragment->len - fragment_window) {
+      fragment->tail_start = index;
+    }
+  }
+
+  for (int i = 0; i < clusters; i++) {
+    fragments[i].next = -1;
+    fragments[i].prev = -1;
+  }
+
+  free(order);
+  free(seen);
+
+  return fragments;
+}
+
+int compare_epoch_order(const void *first, const void *second) {
+  const epoch_order_t *first_order = (const epoch_order_t *)first;
+  const epoch_order_t *second_order = (const epoch_order_t *)second;
+
+  if (first_order->epoch != second_order->epoch) {
+    return first_order->epoch < second_order->epoch ? -1 : 1;
+  }
+
+  return (first_order->index > second_order->index) -
+         (first_order->index < second_order->index);
+}
+
+uint8_t check_fragments(double *data, ptrdiff_t row_stride,
+                        ptrdiff_t col_stride, fragment_t *first,
+                        fragment_t *second, double distance_threshold,
+                        double angle_diff_threshold,
+                        double speed_diff_threshold, double *score) {
+  double tail_start[WIDTH];
+  double last[WIDTH];
+  double head_first[WIDTH];
+  double head_end[WIDTH];
+  double tail_start_unit[3];
+  double last_unit[3];
+  double head_unit[3];
+  double velocity[3] = {0, 0, 0};
+
+  load_point(data, first->tail_start, row_stride, col_stride, tail_start);
+  load_point(data, first->last, row_stride, col_stride, last);
+  load_point(data, second->first, row_stride, col_stride, head_first);
+  load_point(data, second->head_end, row_stride, col_stride, head_end);
+
+  ecef_unit(tail_start, tail_start_unit);
+  ecef_unit(last, last_unit);
+  ecef_unit(head_first, head_unit);
+
+  double tail_time = last[EPOCH] - tail_start[EPOCH];
+  double gap = head_first[EPOCH] - last[EPOCH];
+
+  if (tail_time > 0) {
+    for (unsigned int k = 0; k < 3; k++) {
+      velocity[k] = R * (last_unit[k] - tail_start_unit[k]) / tail_time;
+    }
+  }
+
+  double error = 0;
+
+  for (unsigned int k = 0; k < 3; k++) {
+    double diff = R * (head_unit[k] - last_unit[k]) - velocity[k] * gap;
+    error += diff * diff;
+  }
+
+  *score = sqrt(error);
+
+  if (*score > distance_threshold) {
+    return FALSE;
+  }
+
+  // the angle and speed of a single point window are unknown, like a cluster
+  // shorter than the window in `check_compatibility` they pass
+  if (first->tail_start == first->last || second->first == second->head_end) {
+    return TRUE;
+  }
+
+  double angle_diff = fabs(angle_degree(tail_start, last) -
+                           angle_degree(head_first, head_end));
+  double speed_diff =
+      fabs(calc_speed(tail_start, last) - calc_speed(head_first, head_end));
+
+  return angle_diff <= angle_diff_threshold &&
+         speed_diff <= speed_diff_threshold;
+}
+
+static uint8_t candidate_before(merge_candidate_t *first,
+                                merge_candidate_t *second) {
+  if (first->score != second->score) {
+    return first->score < second->score;
+  }
+
+  if (first->first != second->first) {
+    return first->first < second->first;
+  }
+
+  return first->second < second->second;
+}
+
+void merge_heap_push(merge_heap_t *heap, merge_candidate_t candidate) {
+  if (heap->len == heap->capacity) {
+    heap->capacity = heap->capacity > 0 ? heap->capacity * 2 : 64;
+    heap->items = (merge_candidate_t *)realloc(
+        heap->items, sizeof(merge_candidate_t) * heap->capacity);
+  }
+
+  unsigned int i = heap->len++;
+
+  while (i > 0) {
+    unsigned int parent = (i - 1) / 2;
+
+    if (!candidate_before(&candidate, &heap->items[parent])) {
+      break;
+    }
+
+    heap->items[i] = heap->items[parent];
+    i = parent;
+  }
+
+  heap->items[i] = candidate;
+}
+
+merge_candidate_t merge_heap_pop(merge_heap_t *heap) {
+  merge_candidate_t top = heap->items[0];
+  merge_candidate_t moved = heap->items[--heap->len];
+  unsigned int i = 0;
+
+  while (TRUE) {
+    unsigned int child = 2 * i + 1;
+
+    if (child >= heap->len) {
+      break;
+    }
+
+    if (child + 1 < heap->len &&
+        candidate_before(&heap->items[child + 1], &heap->items[child])) {
+      child++;
+    }
+
+    if (!candidate_before(&heap->items[child], &moved)) {
+      break;
+    }
+
+    heap->items[i] = heap->items[child];
+    i = child;
+  }
+
+  if (heap->len > 0) {
+    heap->items[i] = moved;
+  }
+
+  return top;
+}
@@ -0,0 +1,125 @@
+#ifndef FRAGMENT_MERGE_H
+#define FRAGMENT_MERGE_H
+
+#include "agglomerative.h"
+
+typedef struct fragment_s {
+  // stream index of the first point of the fragment by epoch
+  unsigned int first;
+  // stream index of the last point of the head window by epoch
+  unsigned int head_end;
+  // stream index of the first point of the tail window by epoch
+  unsigned int tail_start;
+  // stream index of the last point of the fragment by epoch
+  unsigned int last;
+  unsigned int len;
+  // fragment that continues this one, -1 if none
+  int next;
+  // fragment this one continues, -1 if none
+  int prev;
+} fragment_t;
+
+typedef struct epoch_order_s {
+  double epoch;
+  // stream index of a point, or id of a fragment
+  unsigned int index;
+} epoch_order_t;
+
+typedef struct merge_candidate_s {
+  // distance between the start of `second` and the end of `first` moved
+  // forward by its velocity over the gap
+  double score;
+  int first;
+  int second;
+} merge_candidate_t;
+
+typedef struct merge_heap_s {
+  merge_candidate_t* items;
+  unsigned int len;
+  unsigned int capacity;
+} merge_heap_t;
+
+/// @brief join the clusters of a pass that are fragments of one trajectory,
+/// a fragment that starts after another one ends is a candidate to continue
+/// it when the gates of `check_compatibility` pass between the tail window of
+/// the first and the head window of the second, and the candidates are merged
+/// best first so every fragment continues at most one fragment
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param distance_threshold maximum distance between the first point of the
+/// second fragment and the last point of the first fragment extrapolated over
+/// the gap with the velocity of its tail
+/// @param angle_diff_threshold maximum heading difference of the tail of the
+/// first fragment and the head of the second
+/// @param speed_diff_threshold maximum speed difference of the tail of the
+/// first fragment and the head of the second
+/// @param window_size number of points of the tail and head windows
+/// @param max_gap maximum seconds between the end of the first fragment and
+/// the start of the second
+/// @param res cluster ids of a pass given in order of first appearance, they
+/// are replaced by the merged ids in the same order. a point without a
+/// cluster keeps its -1
+/// @details the points can be in any order, the fragments are taken by epoch
+/// so the labels of `agglomerative_clustering_unordered` merge like the ones
+/// of the same points sorted
+/// @return the number of merges
+unsigned int merge_fragments(double* data, unsigned int height,
+                             ptrdiff_t row_stride, ptrdiff_t col_stride,
+                             double distance_threshold,
+                             double angle_diff_threshold,
+                             double speed_diff_threshold,
+                             unsigned int window_size, double max_gap,
+                             int* res);
+
+/// @brief find the head and tail windows of every cluster of a pass, the
+/// points of a cluster are taken by epoch, ties in stream order
+/// @param data pointer to the LAT value of the first point
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param res cluster ids of the points, -1 for a point without a cluster
+/// @param height number of data points
+/// @param window_size number of points of the head and tail windows
+/// @param len pointer to the number of fragments
+/// @return array of the fragments by cluster id
+fragment_t* collect_fragments(double* data, ptrdiff_t row_stride,
+                              ptrdiff_t col_stride, int* res,
+                              unsigned int height, unsigned int window_size,
+                              unsigned int* len);
+
+/// @brief order points or fragments by epoch, then by index
+/// @param first first entry
+/// @param second second entry
+/// @return qsort comparison result
+int compare_epoch_order(const void* first, const void* second);
+
+/// @brief gate a fragment continuing another fragment
+/// @param data pointer to the LAT value of the first point
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param first fragment that ends first
+/// @param second fragment that starts after it
+/// @param distance_threshold see `merge_fragments`
+/// @param angle_diff_threshold see `merge_fragments`
+/// @param speed_diff_threshold see `merge_fragments`
+/// @param score pointer to the extrapolated distance of the two fragments
+/// @return boolean value indicating if the fragments are compatible
+uint8_t check_fragments(double* data, ptrdiff_t row_stride,
+                        ptrdiff_t col_stride, fragment_t* first,
+                        fragment_t* second, double distance_threshold,
+                        double angle_diff_threshold,
+                        double speed_diff_threshold, double* score);
+
+/// @brief push a merge candidate
+/// @param heap heap to push to
+/// @param candidate candidate to push
+void merge_heap_push(merge_heap_t* heap, merge_candidate_t candidate);
+
+/// @brief remove the candidate with the lowest score, ties go to the lowest
+/// fragment ids so the merges do not depend on the push order
+/// @param heap non empty heap to pop from
+/// @return the removed candidate
+merge_candidate_t merge_heap_pop(merge_heap_t* heap);
+
+#endif
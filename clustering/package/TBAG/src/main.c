@@ -406,14 +406,8 @@ double data[HEIGHT][WIDTH] = {
 #include "agglomerative.h"
 
 int main(int argc, char** argv, char** wenv) {
-  double* data_pointer[HEIGHT] = {0};
   int res[HEIGHT];
 
-#pragma omp parallel for
-  for (size_t i = 0; i < HEIGHT; i++) {
-    data_pointer[i] = ((double*)(data)) + i * WIDTH;
-  }
-
 #if defined(WIN32) || defined(_WIN32) || \
     defined(__WIN32) && !defined(__CYGWIN__)
   LARGE_INTEGER frequency;
@@ -423,15 +417,15 @@ int main(int argc, char** argv, char** wenv) {
 
   QueryPerformanceFrequency(&frequency);
   QueryPerformanceCounter(&start);
-  agglomerative_clustering(data_pointer, HEIGHT, 2000, INFINITY, 20, INFINITY,
-                           10, res);
+  agglomerative_clustering_strided(NULL, (double*)data, HEIGHT, WIDTH, 1, 2000,
+                                   INFINITY, 20, INFINITY, 10, res);
   QueryPerformanceCounter(&end);
 
   printf("executed in :%.20f seconds\n",
          (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart);
 #else
-  agglomerative_clustering(data_pointer, HEIGHT, 200, INFINITY, 90, INFINITY,
-                           10, res);
+  agglomerative_clustering_strided(NULL, (double*)data, HEIGHT, WIDTH, 1, 200,
+                                   INFINITY, 90, INFINITY, 10, res);
 #endif
   print_array_res(res, HEIGHT);
 
@@ -0,0 +1,151 @@
+#include "reorder_buffer.h"
+
+unsigned int agglomerative_clustering_unordered(
+    clustering_state_t *arena, double *data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double lateness,
+    double distance_threshold, double time_threshold,
+    double angle_diff_threshold, double speed_diff_threshold,
+    unsigned int window_size, int *res) {
+  clustering_state_t *state = arena;
+  reorder_buffer_t buffer;
+  double point[WIDTH];
+
+  if (state == NULL) {
+    state = clustering_init(distance_threshold, time_threshold,
+                            angle_diff_threshold, speed_diff_threshold,
+                            window_size);
+  } else {
+    clustering_reset(state, distance_threshold, time_threshold,
+                     angle_diff_threshold, speed_diff_threshold, window_size);
+  }
+
+  state->emit_finished = FALSE;
+  reorder_buffer_init(&buffer, lateness);
+
+  for (unsigned int i = 0; i < height; i++) {
+    double *row = data + (ptrdiff_t)i * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    reorder_buffer_push(&buffer, state, point, res);
+  }
+
+  reorder_buffer_flush(&buffer, state, res);
+  clustering_flush(state);
+  reorder_buffer_free(&buffer);
+
+  if (arena == NULL) {
+    clustering_destroy(state);
+  }
+
+  return buffer.late;
+}
+
+void reorder_buffer_init(reorder_buffer_t *buffer, double lateness) {
+  memset(buffer, 0, sizeof(reorder_buffer_t));
+  buffer->lateness = lateness;
+  buffer->newest = -INFINITY;
+}
+
+void reorder_buffer_free(reorder_buffer_t *buffer) {
+  free(buffer->items);
+  buffer->items = NULL;
+  buffer->len = 0;
+  buffer->capacity = 0;
+}
+
+static uint8_t entry_before(reorder_entry_t *first, reorder_entry_t *second) {
+  if (first->point[EPOCH] != second->point[EPOCH]) {
+    return first->point[EPOCH] < second->point[EPOCH];
+  }
+
+  return first->index < second->index;
+}
+
+static void release_oldest(reorder_buffer_t *buffer,
+                           clustering_state_t *state, int *res) {
+  reorder_entry_t *items = buffer->items;
+  reorder_entry_t top = items[0];
+  reorder_entry_t moved = items[--buffer->len];
+  unsigned int i = 0;
+
+  while (TRUE) {
+    unsigned int child = 2 * i + 1;
+
+    if (child >= buffer->len) {
+      break;
+    }
+
+    if (child + 1 < buffer->len &&
+        entry_before(&items[child + 1], &items[child])) {
+      child++;
+    }
+
+    if (!entry_before(&items[child], &moved)) {
+      break;
+    }
+
+    items[i] = items[child];
+    i = child;
+  }
+
+  if (buffer->len > 0) {
+    items[i] = moved;
+  }
+
+  res[top.index] = clustering_push_indexed(state, top.point, top.index);
+}
+
+void reorder_buffer_push(reorder_buffer_t *buffer, clustering_state_t *state,
+                         double *point, int *res) {
+  unsigned int index = buffer->arrivals++;
+
+  // the points up to the watermark may already be clustered, an older point
+  // can not be put in order anymore
+  if (point[EPOCH] < buffer->newest - buffer->lateness) {
+    buffer->late++;
+    res[index] = -1;
+    return;
+  }
+
+  if (buffer->len == buffer->capacity) {
+    buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 64;
+    buffer->items = (reorder_entry_t *)realloc(
+        buffer->items, sizeof(reorder_entry_t) * buffer->capacity);
+  }
+
+  reorder_entry_t entry;
+  unsigned int i = buffer->len++;
+
+  memcpy(entry.point, point, sizeof(entry.point));
+  entry.index = index;
+
+  while (i > 0) {
+    unsigned int parent = (i - 1) / 2;
+
+    if (!entry_before(&entry, &buffer->items[parent])) {
+      break;
+    }
+
+    buffer->items[i] = buffer->items[parent];
+    i = parent;
+  }
+
+  buffer->items[i] = entry;
+  buffer->newest = point[EPOCH] > buffer->newest ? point[EPOCH] : buffer->newest;
+
+  double watermark = buffer->newest - buffer->lateness;
+
+  while (buffer->len > 0 && buffer->items[0].point[EPOCH] <= watermark) {
+    release_oldest(buffer, state, res);
+  }
+}
+
+void reorder_buffer_flush(reorder_buffer_t *buffer, clustering_state_t *state,
+                          int *res) {
+  while (buffer->len > 0) {
+    release_oldest(buffer, state, res);
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include "agglomerative.h"
+
+typedef struct reorder_entry_s {
+  double point[WIDTH];
+  // arrival index of the point
+  unsigned int index;
+} reorder_entry_t;
+
+typedef struct reorder_buffer_s {
+  // seconds a point may arrive after a newer point
+  double lateness;
+  // newest epoch that arrived, the watermark is `lateness` before it
+  double newest;
+  // points waiting for the watermark by epoch and arrival
+  reorder_entry_t* items;
+  unsigned int len;
+  unsigned int capacity;
+  // number of points that arrived
+  unsigned int arrivals;
+  // points that arrived behind the watermark and were not clustered
+  unsigned int late;
+} reorder_buffer_t;
+
+/// @brief cluster data points like `agglomerative_clustering_strided` when
+/// they are only roughly sorted, every point waits in a reorder buffer until
+/// no point within `lateness` of it can still arrive, so feeds that interleave
+/// several sorted sources do not need a global sort first
+/// @param arena caller owned state to reuse like in
+/// `agglomerative_clustering_with_arena`, NULL to use a temporary state
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points in arrival order
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param lateness maximum seconds a point may arrive after a newer point,
+/// older points get no cluster
+/// @param res result array in arrival order, -1 for the late points
+/// @return the number of late points
+unsigned int agglomerative_clustering_unordered(
+    clustering_state_t* arena, double* data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double lateness,
+    double distance_threshold, double time_threshold,
+    double angle_diff_threshold, double speed_diff_threshold,
+    unsigned int window_size, int* res);
+
+/// @brief start an empty reorder buffer
+/// @param buffer buffer to initialize
+/// @param lateness maximum seconds a point may arrive after a newer point
+void reorder_buffer_init(reorder_buffer_t* buffer, double lateness);
+
+/// @brief free the points waiting in a reorder buffer
+/// @param buffer reorder buffer
+void reorder_buffer_free(reorder_buffer_t* buffer);
+
+/// @brief take the next arriving point, then cluster every waiting point the
+/// watermark passed in epoch order, ties in arrival order. a point older than
+/// the watermark is late, it is counted and labelled -1
+/// @param buffer reorder buffer
+/// @param state clustering state the points are released to, the finished
+/// clusters hold the arrival indices of their points
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @param res result array by arrival index, the label of a point is written
+/// when it is released
+void reorder_buffer_push(reorder_buffer_t* buffer, clustering_state_t* state,
+                         double* point, int* res);
+
+/// @brief cluster every waiting point, this should be called at the end of
+/// the stream before `clustering_flush`
+/// @param buffer reorder buffer
+/// @param state clustering state the points are released to
+/// @param res result array by arrival index
+void reorder_buffer_flush(reorder_buffer_t* buffer, clustering_state_t* state,
+                          int* res);
+
+#endif
@@ -0,0 +1,232 @@
+#include "scan_batch.h"
+
+void agglomerative_clustering_scans(
+    clustering_state_t *arena, double *data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int *res) {
+  clustering_state_t *state = arena;
+
+  if (state == NULL) {
+    state = clustering_init(distance_threshold, time_threshold,
+                            angle_diff_threshold, speed_diff_threshold,
+                            window_size);
+  } else {
+    clustering_reset(state, distance_threshold, time_threshold,
+                     angle_diff_threshold, speed_diff_threshold, window_size);
+  }
+
+  state->emit_finished = FALSE;
+
+  clustering_push_scans(state, data, height, row_stride, col_stride, res);
+  clustering_flush(state);
+
+  if (arena == NULL) {
+    clustering_destroy(state);
+  }
+}
+
+void clustering_push_scans(clustering_state_t *state, double *data,
+                           unsigned int count, ptrdiff_t row_stride,
+                           ptrdiff_t col_stride, int *res) {
+  scan_batch_t batch;
+  double point[WIDTH];
+
+  scan_batch_init(&batch);
+
+  for (unsigned int i = 0; i < count; i++) {
+    double *row = data + (ptrdiff_t)i * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    scan_batch_push(&batch, state, point, state->points_seen++, &res[i]);
+  }
+
+  scan_batch_resolve(&batch, state);
+  scan_batch_free(&batch);
+}
+
+void scan_batch_init(scan_batch_t *batch) {
+  memset(batch, 0, sizeof(scan_batch_t));
+}
+
+void scan_batch_free(scan_batch_t *batch) {
+  free(batch->points);
+  free(batch->units);
+  free(batch->indices);
+  free(batch->labels);
+  free(batch->pairs);
+  free(batch->assigned);
+  free(batch->taken);
+  memset(batch, 0, sizeof(scan_batch_t));
+}
+
+void scan_batch_push(scan_batch_t *batch, clustering_state_t *state,
+                     double *point, unsigned int index, int *label) {
+  if (batch->len > 0 && point[EPOCH] != batch->epoch) {
+    scan_batch_resolve(batch, state);
+  }
+
+  if (batch->len == batch->capacity) {
+    batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+    batch->points = (double(*)[WIDTH])realloc(
+        batch->points, sizeof(double[WIDTH]) * batch->capacity);
+    batch->units = (double(*)[3])realloc(batch->units,
+                                         sizeof(double[3]) * batch->capacity);
+    batch->indices = (unsigned int *)realloc(
+        batch->indices, sizeof(unsigned int) * batch->capacity);
+    batch->labels =
+        (int **)realloc(batch->labels, sizeof(int *) * batch->capacity);
+    batch->assigned =
+        (int *)realloc(batch->assigned, sizeof(int) * batch->capacity);
+  }
+
+  unsigned int i = batch->len++;
+
+  memcpy(batch->points[i], point, sizeof(double[WIDTH]));
+  ecef_unit(point, batch->units[i]);
+  batch->indices[i] = index;
+  batch->labels[i] = label;
+  batch->epoch = point[EPOCH];
+}
+
+static int compare_scan_pairs(const void *first, const void *second) {
+  const scan_pair_t *a = (const scan_pair_t *)first;
+  const scan_pair_t *b = (const scan_pair_t *)second;
+
+  if (a->score != b->score) {
+    return a->score < b->score ? -1 : 1;
+  }
+
+  // equally close pairs go to the older cluster and then the earlier point,
+  // like the ties of `consider_candidate`
+  if (a->id != b->id) {
+    return a->id < b->id ? -1 : 1;
+  }
+
+  return a->point < b->point ? -1 : a->point > b->point;
+}
+
+// evaluate the open clusters for one point of the scan and keep the
+// compatible pairs, a cluster that is not the closest for the point can still
+// be the one it gets so nothing is pruned
+static void collect_pairs(scan_batch_t *batch, clustering_state_t *state,
+                          unsigned int point) {
+  int *candidates = NULL;
+  gate_t gate;
+
+  memcpy(state->point_unit, batch->units[point], sizeof(state->point_unit));
+  prepare_search(state, batch->points[point], &gate);
+
+  unsigned int count = collect_candidates(state, &candidates);
+
+  state->kernel(&state->table, candidates, count, batch->points[point], &gate,
+                NULL, state->gate_compatible, state->gate_distance,
+                state->gate_angle);
+
+  if (STATS_ENABLED(state)) {
+    record_candidates(state, candidates, count, batch->points[point], &gate);
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (state->gate_compatible[i] != TRUE) {
+      continue;
+    }
+
+    if (batch->pairs_len == batch->pairs_capacity) {
+      batch->pairs_capacity =
+          batch->pairs_capacity ? batch->pairs_capacity * 2 : 64;
+      batch->pairs = (scan_pair_t *)realloc(
+          batch->pairs, sizeof(scan_pair_t) * batch->pairs_capacity);
+    }
+
+    scan_pair_t *pair = &batch->pairs[batch->pairs_len++];
+    pair->score = sqrt(pow(state->gate_distance[i], 2) +
+                       pow(state->gate_angle[i], 2));
+    pair->point = point;
+    pair->slot = candidates[i];
+    pair->id = state->clusters[candidates[i]].id;
+  }
+}
+
+void scan_batch_resolve(scan_batch_t *batch, clustering_state_t *state) {
+  double clock = 0;
+
+  if (batch->len == 0) {
+    return;
+  }
+
+  if (STATS_ENABLED(state)) {
+    state->stats->points += batch->len;
+    clock = stats_clock();
+  }
+
+  retire_stale_clusters(state, batch->epoch);
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->label_seconds, &clock);
+  }
+
+  // the points of the scan are evaluated one after the other against the
+  // same tail table rows, so the rows stay in cache for the whole scan
+  batch->pairs_len = 0;
+
+  for (unsigned int i = 0; i < batch->len; i++) {
+    batch->assigned[i] = -1;
+    collect_pairs(batch, state, i);
+  }
+
+  if (state->cluster_len >= batch->taken_capacity) {
+    batch->taken_capacity = state->cluster_len + 16;
+    batch->taken = (uint8_t *)realloc(batch->taken, batch->taken_capacity);
+  }
+
+  memset(batch->taken, FALSE, state->cluster_len);
+
+  if (batch->pairs_len > 0) {
+    qsort(batch->pairs, batch->pairs_len, sizeof(scan_pair_t),
+          compare_scan_pairs);
+  }
+
+  for (unsigned int i = 0; i < batch->pairs_len; i++) {
+    scan_pair_t *pair = &batch->pairs[i];
+
+    if (batch->assigned[pair->point] == -1 && !batch->taken[pair->slot]) {
+      batch->assigned[pair->point] = pair->slot;
+      batch->taken[pair->slot] = TRUE;
+    }
+  }
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->search_seconds, &clock);
+  }
+
+  // the clusters of the scan are extended first, the points left then start
+  // their clusters in scan order
+  for (unsigned int i = 0; i < batch->len; i++) {
+    int slot = batch->assigned[i];
+
+    if (slot != -1) {
+      memcpy(state->point_unit, batch->units[i], sizeof(state->point_unit));
+      add_to_cluster(state, &state->clusters[slot], batch->points[i],
+                     batch->indices[i]);
+      *batch->labels[i] = state->clusters[slot].id;
+    }
+  }
+
+  for (unsigned int i = 0; i < batch->len; i++) {
+    if (batch->assigned[i] == -1) {
+      memcpy(state->point_unit, batch->units[i], sizeof(state->point_unit));
+      *batch->labels[i] =
+          add_new_cluster(state, batch->points[i], batch->indices[i]);
+    }
+  }
+
+  if (STATS_ENABLED(state)) {
+    stats_lap(&state->stats->append_seconds, &clock);
+  }
+
+  batch->len = 0;
+}
@@ -0,0 +1,94 @@
+#ifndef SCAN_BATCH_H
+#define SCAN_BATCH_H
+
+#include "agglomerative.h"
+
+typedef struct scan_pair_s {
+  // score of the cluster for the point like in `closest_candidate`
+  double score;
+  // position of the point in the scan
+  unsigned int point;
+  int slot;
+  int id;
+} scan_pair_t;
+
+typedef struct scan_batch_s {
+  // epoch of the points waiting in the batch
+  double epoch;
+  double (*points)[WIDTH];
+  double (*units)[3];
+  // stream index of every point and where its label is written
+  unsigned int* indices;
+  int** labels;
+  unsigned int len;
+  unsigned int capacity;
+  // compatible point and cluster pairs of the scan
+  scan_pair_t* pairs;
+  unsigned int pairs_len;
+  unsigned int pairs_capacity;
+  // slot every point of the scan is assigned to, -1 for a new cluster
+  int* assigned;
+  // TRUE for the slots that took a point of the scan
+  uint8_t* taken;
+  unsigned int taken_capacity;
+} scan_batch_t;
+
+/// @brief cluster data points like `agglomerative_clustering_strided`, but
+/// the points that share an epoch are clustered together as one scan, so
+/// every cluster takes at most one point of a scan and the closest pairs of
+/// the whole scan are joined first instead of the first points of the scan
+/// taking the clusters greedily
+/// @param arena caller owned state to reuse like in
+/// `agglomerative_clustering_with_arena`, NULL to use a temporary state
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points sorted by epoch
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param res result array
+void agglomerative_clustering_scans(
+    clustering_state_t* arena, double* data, unsigned int height,
+    ptrdiff_t row_stride, ptrdiff_t col_stride, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int* res);
+
+/// @brief cluster the next points of a stream like `clustering_push_strided`
+/// one scan at a time, the last scan of the points is clustered before
+/// returning so a scan should not be split between two calls
+/// @param state clustering state of the stream
+/// @param data pointer to the LAT value of the first point
+/// @param count number of data points sorted by epoch
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param res result array for the cluster id of every point
+void clustering_push_scans(clustering_state_t* state, double* data,
+                           unsigned int count, ptrdiff_t row_stride,
+                           ptrdiff_t col_stride, int* res);
+
+/// @brief start an empty scan batch
+/// @param batch batch to initialize
+void scan_batch_init(scan_batch_t* batch);
+
+/// @brief free the storage of a scan batch
+/// @param batch scan batch
+void scan_batch_free(scan_batch_t* batch);
+
+/// @brief take the next point of the stream, the waiting scan is clustered
+/// first when the point is newer than it
+/// @param batch scan batch
+/// @param state clustering state the scans are clustered in
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @param index stream index of the point
+/// @param label where the cluster id of the point is written once its scan is
+/// clustered
+void scan_batch_push(scan_batch_t* batch, clustering_state_t* state,
+                     double* point, unsigned int index, int* label);
+
+/// @brief cluster the waiting scan. every point is evaluated against the open
+/// clusters with the compatibility kernel, the compatible pairs are joined
+/// from the lowest score up while neither the point nor the cluster has one,
+/// and the points left start new clusters in scan order
+/// @param batch scan batch
+/// @param state clustering state the scan is clustered in
+void scan_batch_resolve(scan_batch_t* batch, clustering_state_t* state);
+
+#endif
@@ -0,0 +1,764 @@
+#include "agglomerative.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// the kernel bodies are inlined into a wrapper for every combination of
+// `kernel_gates`, so the gates that are off are folded away
+#ifdef __GNUC__
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+#define KERNEL_VARIANT(body, gates, target)                                   \
+  target static void body##_##gates(                                          \
+      tail_table_t *table, int *slots, unsigned int count, double *point,     \
+      gate_t *gate, double *bound, uint8_t *compatible, double *distance,     \
+      double *angle) {                                                        \
+    body(table, slots, count, point, gate, bound, compatible, distance,       \
+         angle, gates);                                                       \
+  }
+
+#define KERNEL_VARIANTS(body, target)                                         \
+  KERNEL_VARIANT(body, 0, target)                                             \
+  KERNEL_VARIANT(body, 1, target)                                             \
+  KERNEL_VARIANT(body, 2, target)                                             \
+  KERNEL_VARIANT(body, 3, target)                                             \
+  static const compatibility_kernel_t body##_variants[KERNEL_GATES] = {       \
+      body##_0, body##_1, body##_2, body##_3};
+
+#define PI_A 3.141592653589793116
+// cephes rational approximation of atan on [-0.66, 0.66]
+#define ATAN_P0 -8.750608600031904122785e-1
+#define ATAN_P1 -1.615753718733365076637e1
+#define ATAN_P2 -7.500855792314704667340e1
+#define ATAN_P3 -1.228866684490136173410e2
+#define ATAN_P4 -6.485021904942025371773e1
+#define ATAN_Q0 2.485846490142306297962e1
+#define ATAN_Q1 1.650270098316988542046e2
+#define ATAN_Q2 4.328810604912902668951e2
+#define ATAN_Q3 4.853903996359136964868e2
+#define ATAN_Q4 1.945506571482613964425e2
+
+void tail_table_reserve(tail_table_t *table, unsigned int capacity) {
+  if (capacity <= table->capacity) {
+    return;
+  }
+
+  double *storage = (double *)malloc(sizeof(double) * TAIL_COLUMNS * capacity);
+
+  for (unsigned int i = 0; i < TAIL_COLUMNS; i++) {
+    if (table->capacity) {
+      memcpy(storage + (size_t)i * capacity, table->columns[i],
+             sizeof(double) * table->capacity);
+    }
+  }
+
+  free(table->columns[0]);
+
+  for (unsigned int i = 0; i < TAIL_COLUMNS; i++) {
+    table->columns[i] = storage + (size_t)i * capacity;
+  }
+
+  table->capacity = capacity;
+}
+
+void tail_table_free(tail_table_t *table) {
+  free(table->columns[0]);
+  memset(table, 0, sizeof(tail_table_t));
+}
+
+// haversine distance from the chord between the unit vectors, sin^2 of half
+// the central angle is a quarter of the squared chord
+static inline double chord_distance(double *unit, double x, double y, double z,
+                                    double alt_diff) {
+  double dx = unit[0] - x;
+  double dy = unit[1] - y;
+  double dz = unit[2] - z;
+  double a = (dx * dx + dy * dy + dz * dz) / 4;
+  double c = 2 * asin(sqrt(a < 1 ? a : 1));
+
+  return sqrt(pow(R * c, 2) + alt_diff * alt_diff);
+}
+
+// unit vector and altitude of the last point of a slot, moved by the
+// velocity of the cluster to the epoch of the point for the motion gate
+static inline void tail_position(double **columns, int slot, double *point,
+                                 gate_t *gate, double *res) {
+  res[0] = columns[TAIL_X][slot];
+  res[1] = columns[TAIL_Y][slot];
+  res[2] = columns[TAIL_Z][slot];
+  res[3] = columns[TAIL_ALT][slot];
+
+  if (gate->motion) {
+    double elapsed = point[EPOCH] - columns[TAIL_EPOCH][slot];
+
+    res[0] += columns[VELOCITY_X][slot] * elapsed;
+    res[1] += columns[VELOCITY_Y][slot] * elapsed;
+    res[2] += columns[VELOCITY_Z][slot] * elapsed;
+    res[3] += columns[VELOCITY_ALT][slot] * elapsed;
+  }
+}
+
+static double slot_distance(double **columns, int slot, double *point,
+                            gate_t *gate) {
+  if (!gate->motion) {
+    double tail[WIDTH] = {columns[TAIL_LAT][slot], columns[TAIL_LON][slot],
+                          columns[TAIL_ALT][slot], columns[TAIL_EPOCH][slot]};
+
+    return haversine_distance(tail, point);
+  }
+
+  double position[4];
+  tail_position(columns, slot, point, gate, position);
+
+  return chord_distance(gate->unit, position[0], position[1], position[2],
+                        point[ALT] - position[3]);
+}
+
+// distance threshold of one slot, with the motion gate the clusters that have
+// a velocity have their own
+static inline double slot_threshold(double **columns, int slot, gate_t *gate) {
+  return gate->motion ? columns[DISTANCE_GATE][slot] : gate->distance_threshold;
+}
+
+double gate_distance(tail_table_t *table, int slot, double *point,
+                     gate_t *gate) {
+  return slot_distance(table->columns, slot, point, gate);
+}
+
+// gates of one slot with the library functions, for the candidates whose
+// values are too close to a threshold to trust the kernels
+static void evaluate_exact(double **columns, int slot, double *point,
+                           gate_t *gate, uint8_t *compatible, double *distance,
+                           double *angle) {
+  double mean[WIDTH] = {columns[MEAN_LAT][slot], columns[MEAN_LON][slot],
+                        columns[MEAN_ALT][slot], columns[MEAN_EPOCH][slot]};
+  double speed_diff = gate->speed_diff_threshold;
+
+  // same order of evaluation as `check_compatibility`
+  *distance = slot_distance(columns, slot, point, gate);
+  *angle = gate->angle_diff_threshold;
+
+  if (columns[WINDOW_READY][slot] != 0) {
+    speed_diff = fabs(columns[GENERAL_SPEED][slot] - calc_speed(mean, point));
+    *angle = fabs(columns[GENERAL_ANGLE][slot] - angle_degree(mean, point));
+  }
+
+  double time_diff = fabs(point[EPOCH] - columns[TAIL_EPOCH][slot]);
+  *compatible = *distance <= slot_threshold(columns, slot, gate) &&
+                *angle <= gate->angle_diff_threshold &&
+                speed_diff <= gate->speed_diff_threshold &&
+                time_diff <= gate->time_threshold;
+}
+
+// lower the best score with a compatible candidate
+static inline void update_bound(double *bound, uint8_t compatible,
+                                double distance, double angle) {
+  if (bound != NULL && compatible == TRUE) {
+    double score = sqrt(pow(distance, 2) + pow(angle, 2));
+    *bound = score < *bound ? score : *bound;
+  }
+}
+
+static KERNEL_INLINE void kernel_scalar(tail_table_t *table, int *slots,
+                                        unsigned int count, double *point,
+                                        gate_t *gate, double *bound,
+                                        uint8_t *compatible, double *distance,
+                                        double *angle, unsigned int gates) {
+  double **columns = table->columns;
+
+  for (unsigned int i = 0; i < count; i++) {
+    int slot = slots[i];
+
+    // the time gate is exact and costs a subtraction, so it goes first
+    if ((gates & KERNEL_GATE_TIME) &&
+        !(fabs(point[EPOCH] - columns[TAIL_EPOCH][slot]) <=
+          gate->time_threshold)) {
+      compatible[i] = FALSE;
+      continue;
+    }
+
+    double threshold = slot_threshold(columns, slot, gate);
+    double distance_error =
+        KERNEL_TOLERANCE * threshold + KERNEL_DISTANCE_ERROR;
+    double position[4];
+    tail_position(columns, slot, point, gate, position);
+    distance[i] = chord_distance(gate->unit, position[0], position[1],
+                                 position[2], point[ALT] - position[3]);
+
+    if (!(distance[i] <= threshold + distance_error)) {
+      compatible[i] = FALSE;
+      continue;
+    }
+
+    // the score is at least the distance, so a candidate farther than the
+    // best score can not win and its window is not evaluated
+    if (bound != NULL && distance[i] > *bound + distance_error) {
+      compatible[i] = KERNEL_PRUNED;
+      continue;
+    }
+
+    if (fabs(distance[i] - threshold) <= distance_error) {
+      evaluate_exact(columns, slot, point, gate, &compatible[i], &distance[i],
+                     &angle[i]);
+      update_bound(bound, compatible[i], distance[i], angle[i]);
+      continue;
+    }
+
+    double speed_diff = gate->speed_diff_threshold;
+    double speed_error = 0;
+    angle[i] = gate->angle_diff_threshold;
+
+    if (columns[WINDOW_READY][slot] != 0 && (gates & KERNEL_GATE_SPEED)) {
+      double mean_distance = chord_distance(
+          gate->unit, columns[MEAN_X][slot], columns[MEAN_Y][slot],
+          columns[MEAN_Z][slot], point[ALT] - columns[MEAN_ALT][slot]);
+      double time_diff = point[EPOCH] - columns[MEAN_EPOCH][slot];
+
+      if (time_diff != 0) {
+        speed_diff =
+            fabs(columns[GENERAL_SPEED][slot] - mean_distance / time_diff);
+        speed_error =
+            (KERNEL_TOLERANCE * mean_distance + KERNEL_DISTANCE_ERROR) /
+            fabs(time_diff);
+      } else {
+        speed_diff = fabs(columns[GENERAL_SPEED][slot]);
+      }
+    }
+
+    if (columns[WINDOW_READY][slot] != 0) {
+      // same expression as `angle_degree`
+      angle[i] = fabs(columns[GENERAL_ANGLE][slot] -
+                      atan2(point[LAT] - columns[MEAN_LAT][slot],
+                            point[LON] - columns[MEAN_LON][slot]) *
+                          180 / PI);
+    }
+
+    if ((gates & KERNEL_GATE_SPEED) &&
+        fabs(speed_diff - gate->speed_diff_threshold) <= speed_error) {
+      evaluate_exact(columns, slot, point, gate, &compatible[i], &distance[i],
+                     &angle[i]);
+    } else {
+      compatible[i] = angle[i] <= gate->angle_diff_threshold &&
+                      speed_diff <= gate->speed_diff_threshold;
+    }
+
+    update_bound(bound, compatible[i], distance[i], angle[i]);
+  }
+}
+
+KERNEL_VARIANTS(kernel_scalar, )
+
+#ifdef KERNEL_X86
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static inline __m256d atan_unit_avx2(__m256d t) {
+  __m256d one = _mm256_set1_pd(1);
+  __m256d big = _mm256_cmp_pd(t, _mm256_set1_pd(0.66), _CMP_GT_OQ);
+  __m256d u = _mm256_blendv_pd(
+      t, _mm256_div_pd(_mm256_sub_pd(t, one), _mm256_add_pd(t, one)), big);
+  __m256d base = _mm256_and_pd(big, _mm256_set1_pd(PI_A / 4));
+
+  __m256d z = _mm256_mul_pd(u, u);
+  __m256d p = _mm256_set1_pd(ATAN_P0);
+  p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(ATAN_P1));
+  p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(ATAN_P2));
+  p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(ATAN_P3));
+  p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(ATAN_P4));
+  __m256d q = _mm256_add_pd(z, _mm256_set1_pd(ATAN_Q0));
+  q = _mm256_fmadd_pd(q, z, _mm256_set1_pd(ATAN_Q1));
+  q = _mm256_fmadd_pd(q, z, _mm256_set1_pd(ATAN_Q2));
+  q = _mm256_fmadd_pd(q, z, _mm256_set1_pd(ATAN_Q3));
+  q = _mm256_fmadd_pd(q, z, _mm256_set1_pd(ATAN_Q4));
+
+  __m256d r = _mm256_fmadd_pd(_mm256_mul_pd(u, z), _mm256_div_pd(p, q), u);
+  return _mm256_add_pd(r, base);
+}
+
+AVX2 static inline __m256d atan2_avx2(__m256d y, __m256d x) {
+  __m256d zero = _mm256_setzero_pd();
+  __m256d sign = _mm256_set1_pd(-0.0);
+  __m256d ax = _mm256_andnot_pd(sign, x);
+  __m256d ay = _mm256_andnot_pd(sign, y);
+  __m256d max = _mm256_max_pd(ax, ay);
+  __m256d t = _mm256_div_pd(_mm256_min_pd(ax, ay), max);
+  // atan2(0, 0) is 0
+  t = _mm256_blendv_pd(t, zero, _mm256_cmp_pd(max, zero, _CMP_EQ_OQ));
+
+  __m256d r = atan_unit_avx2(t);
+  r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(PI_A / 2), r),
+                       _mm256_cmp_pd(ay, ax, _CMP_GT_OQ));
+  r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(PI_A), r),
+                       _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+  return _mm256_blendv_pd(r, _mm256_sub_pd(zero, r),
+                          _mm256_cmp_pd(y, zero, _CMP_LT_OQ));
+}
+
+AVX2 static inline __m256d chord_distance_avx2(__m256d dx, __m256d dy,
+                                               __m256d dz, __m256d dalt) {
+  __m256d one = _mm256_set1_pd(1);
+  __m256d a = _mm256_mul_pd(
+      _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz))),
+      _mm256_set1_pd(0.25));
+  a = _mm256_min_pd(a, one);
+  __m256d c = _mm256_mul_pd(
+      _mm256_set1_pd(2),
+      atan2_avx2(_mm256_sqrt_pd(a), _mm256_sqrt_pd(_mm256_sub_pd(one, a))));
+  __m256d arc = _mm256_mul_pd(_mm256_set1_pd(R), c);
+  return _mm256_sqrt_pd(
+      _mm256_fmadd_pd(arc, arc, _mm256_mul_pd(dalt, dalt)));
+}
+
+AVX2 static KERNEL_INLINE void kernel_avx2(tail_table_t *table, int *slots,
+                                           unsigned int count, double *point,
+                                           gate_t *gate, double *bound,
+                                           uint8_t *compatible,
+                                           double *distance, double *angle,
+                                           unsigned int gates) {
+  double **columns = table->columns;
+  __m256d zero = _mm256_setzero_pd();
+  __m256d sign = _mm256_set1_pd(-0.0);
+  __m256d lat = _mm256_set1_pd(point[LAT]);
+  __m256d lon = _mm256_set1_pd(point[LON]);
+  __m256d alt = _mm256_set1_pd(point[ALT]);
+  __m256d epoch = _mm256_set1_pd(point[EPOCH]);
+  __m256d x = _mm256_set1_pd(gate->unit[0]);
+  __m256d y = _mm256_set1_pd(gate->unit[1]);
+  __m256d z = _mm256_set1_pd(gate->unit[2]);
+  __m256d distance_threshold = _mm256_set1_pd(gate->distance_threshold);
+  __m256d time_threshold = _mm256_set1_pd(gate->time_threshold);
+  __m256d angle_threshold = _mm256_set1_pd(gate->angle_diff_threshold);
+  __m256d speed_threshold = _mm256_set1_pd(gate->speed_diff_threshold);
+  __m256d distance_error = _mm256_set1_pd(
+      KERNEL_TOLERANCE * gate->distance_threshold + KERNEL_DISTANCE_ERROR);
+  __m256d angle_error = _mm256_set1_pd(
+      KERNEL_TOLERANCE * gate->angle_diff_threshold + KERNEL_ANGLE_ERROR);
+
+  for (unsigned int i = 0; i < count; i += 4) {
+    unsigned int lanes = count - i < 4 ? count - i : 4;
+    int valid = (1 << lanes) - 1;
+    int indices[4];
+
+    // the missing lanes of the last block repeat a valid slot
+    for (unsigned int j = 0; j < 4; j++) {
+      indices[j] = slots[i + (j < lanes ? j : 0)];
+    }
+
+    __m128i index = _mm_loadu_si128((__m128i *)indices);
+#define GATHER(column) _mm256_i32gather_pd(columns[column], index, 8)
+
+    __m256d elapsed = zero;
+    __m256d in_time = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+
+    if ((gates & KERNEL_GATE_TIME) || gate->motion) {
+      elapsed = _mm256_sub_pd(epoch, GATHER(TAIL_EPOCH));
+    }
+
+    // the time gate is exact and costs a subtraction, so it goes first
+    if (gates & KERNEL_GATE_TIME) {
+      in_time = _mm256_cmp_pd(_mm256_andnot_pd(sign, elapsed), time_threshold,
+                              _CMP_LE_OQ);
+
+      if ((_mm256_movemask_pd(in_time) & valid) == 0) {
+        memset(compatible + i, FALSE, lanes);
+        continue;
+      }
+    }
+
+    __m256d tail_x = GATHER(TAIL_X);
+    __m256d tail_y = GATHER(TAIL_Y);
+    __m256d tail_z = GATHER(TAIL_Z);
+    __m256d tail_alt = GATHER(TAIL_ALT);
+
+    __m256d threshold = distance_threshold;
+    __m256d error = distance_error;
+
+    if (gate->motion) {
+      threshold = GATHER(DISTANCE_GATE);
+      error = _mm256_fmadd_pd(threshold, _mm256_set1_pd(KERNEL_TOLERANCE),
+                              _mm256_set1_pd(KERNEL_DISTANCE_ERROR));
+      tail_x = _mm256_fmadd_pd(GATHER(VELOCITY_X), elapsed, tail_x);
+      tail_y = _mm256_fmadd_pd(GATHER(VELOCITY_Y), elapsed, tail_y);
+      tail_z = _mm256_fmadd_pd(GATHER(VELOCITY_Z), elapsed, tail_z);
+      tail_alt = _mm256_fmadd_pd(GATHER(VELOCITY_ALT), elapsed, tail_alt);
+    }
+
+    __m256d range = _mm256_add_pd(threshold, error);
+    __m256d tail_distance = chord_distance_avx2(
+        _mm256_sub_pd(x, tail_x), _mm256_sub_pd(y, tail_y),
+        _mm256_sub_pd(z, tail_z), _mm256_sub_pd(alt, tail_alt));
+
+    // the score is at least the distance, so the lanes farther than the best
+    // score can not win and their windows are not evaluated
+    int in_range = _mm256_movemask_pd(_mm256_and_pd(
+        in_time, _mm256_cmp_pd(tail_distance, range, _CMP_LE_OQ)));
+    double best = bound != NULL ? *bound : INFINITY;
+    int in_bound = _mm256_movemask_pd(_mm256_cmp_pd(
+        tail_distance, _mm256_add_pd(_mm256_set1_pd(best), error), _CMP_LE_OQ));
+    int live = in_range & in_bound & valid;
+
+    if (live == 0) {
+      for (unsigned int j = 0; j < lanes; j++) {
+        compatible[i + j] = (in_range >> j) & 1 ? KERNEL_PRUNED : FALSE;
+      }
+
+      continue;
+    }
+
+    __m256d mean_dlat = _mm256_sub_pd(lat, GATHER(MEAN_LAT));
+    __m256d mean_dlon = _mm256_sub_pd(lon, GATHER(MEAN_LON));
+    __m256d speed_diff = speed_threshold;
+    __m256d speed_error = zero;
+
+    if (gates & KERNEL_GATE_SPEED) {
+      __m256d mean_distance = chord_distance_avx2(
+          _mm256_sub_pd(x, GATHER(MEAN_X)), _mm256_sub_pd(y, GATHER(MEAN_Y)),
+          _mm256_sub_pd(z, GATHER(MEAN_Z)),
+          _mm256_sub_pd(alt, GATHER(MEAN_ALT)));
+      __m256d mean_time = _mm256_sub_pd(epoch, GATHER(MEAN_EPOCH));
+      __m256d no_time = _mm256_cmp_pd(mean_time, zero, _CMP_EQ_OQ);
+      __m256d speed = _mm256_blendv_pd(
+          _mm256_div_pd(mean_distance, mean_time), zero, no_time);
+      speed_error = _mm256_blendv_pd(
+          _mm256_div_pd(
+              _mm256_fmadd_pd(mean_distance, _mm256_set1_pd(KERNEL_TOLERANCE),
+                              _mm256_set1_pd(KERNEL_DISTANCE_ERROR)),
+              _mm256_andnot_pd(sign, mean_time)),
+          zero, no_time);
+      speed_diff =
+          _mm256_andnot_pd(sign, _mm256_sub_pd(GATHER(GENERAL_SPEED), speed));
+    }
+
+    __m256d angle_diff = _mm256_andnot_pd(
+        sign, _mm256_sub_pd(GATHER(GENERAL_ANGLE),
+                            _mm256_div_pd(_mm256_mul_pd(atan2_avx2(mean_dlat,
+                                                                   mean_dlon),
+                                                        _mm256_set1_pd(180)),
+                                          _mm256_set1_pd(PI))));
+
+    // clusters smaller than the window pass the speed and angle gates
+    __m256d ready = _mm256_cmp_pd(GATHER(WINDOW_READY), zero, _CMP_NEQ_OQ);
+    speed_diff = _mm256_blendv_pd(speed_threshold, speed_diff, ready);
+    angle_diff = _mm256_blendv_pd(angle_threshold, angle_diff, ready);
+#undef GATHER
+
+    __m256d pass = _mm256_and_pd(
+        _mm256_and_pd(
+            _mm256_cmp_pd(tail_distance, threshold, _CMP_LE_OQ),
+            _mm256_cmp_pd(angle_diff, angle_threshold, _CMP_LE_OQ)),
+        in_time);
+    __m256d near_window = _mm256_cmp_pd(
+        _mm256_andnot_pd(sign, _mm256_sub_pd(angle_diff, angle_threshold)),
+        angle_error, _CMP_LE_OQ);
+
+    if (gates & KERNEL_GATE_SPEED) {
+      pass = _mm256_and_pd(
+          pass, _mm256_cmp_pd(speed_diff, speed_threshold, _CMP_LE_OQ));
+      near_window = _mm256_or_pd(
+          near_window,
+          _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(
+                                                   speed_diff, speed_threshold)),
+                        speed_error, _CMP_LE_OQ));
+    }
+
+    __m256d near = _mm256_or_pd(
+        _mm256_cmp_pd(
+            _mm256_andnot_pd(sign,
+                             _mm256_sub_pd(tail_distance, threshold)),
+            error, _CMP_LE_OQ),
+        _mm256_and_pd(ready, near_window));
+
+    double lane_distance[4];
+    double lane_angle[4];
+    int mask = _mm256_movemask_pd(pass);
+    int exact = _mm256_movemask_pd(near);
+    _mm256_storeu_pd(lane_distance, tail_distance);
+    _mm256_storeu_pd(lane_angle, angle_diff);
+
+    for (unsigned int j = 0; j < lanes; j++) {
+      if (!((live >> j) & 1)) {
+        compatible[i + j] = (in_range >> j) & 1 ? KERNEL_PRUNED : FALSE;
+        continue;
+      }
+
+      distance[i + j] = lane_distance[j];
+      angle[i + j] = lane_angle[j];
+      compatible[i + j] = (mask >> j) & 1;
+
+      if ((exact >> j) & 1) {
+        evaluate_exact(columns, indices[j], point, gate, &compatible[i + j],
+                       &distance[i + j], &angle[i + j]);
+      }
+
+      update_bound(bound, compatible[i + j], distance[i + j], angle[i + j]);
+    }
+  }
+}
+
+KERNEL_VARIANTS(kernel_avx2, AVX2)
+
+#define AVX512 __attribute__((target("avx512f")))
+
+AVX512 static inline __m512d atan_unit_avx512(__m512d t) {
+  __m512d one = _mm512_set1_pd(1);
+  __mmask8 big = _mm512_cmp_pd_mask(t, _mm512_set1_pd(0.66), _CMP_GT_OQ);
+  __m512d u = _mm512_mask_div_pd(t, big, _mm512_sub_pd(t, one),
+                                 _mm512_add_pd(t, one));
+  __m512d base =
+      _mm512_mask_blend_pd(big, _mm512_setzero_pd(), _mm512_set1_pd(PI_A / 4));
+
+  __m512d z = _mm512_mul_pd(u, u);
+  __m512d p = _mm512_set1_pd(ATAN_P0);
+  p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(ATAN_P1));
+  p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(ATAN_P2));
+  p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(ATAN_P3));
+  p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(ATAN_P4));
+  __m512d q = _mm512_add_pd(z, _mm512_set1_pd(ATAN_Q0));
+  q = _mm512_fmadd_pd(q, z, _mm512_set1_pd(ATAN_Q1));
+  q = _mm512_fmadd_pd(q, z, _mm512_set1_pd(ATAN_Q2));
+  q = _mm512_fmadd_pd(q, z, _mm512_set1_pd(ATAN_Q3));
+  q = _mm512_fmadd_pd(q, z, _mm512_set1_pd(ATAN_Q4));
+
+  __m512d r = _mm512_fmadd_pd(_mm512_mul_pd(u, z), _mm512_div_pd(p, q), u);
+  return _mm512_add_pd(r, base);
+}
+
+AVX512 static inline __m512d atan2_avx512(__m512d y, __m512d x) {
+  __m512d zero = _mm512_setzero_pd();
+  __m512d ax = _mm512_abs_pd(x);
+  __m512d ay = _mm512_abs_pd(y);
+  __m512d max = _mm512_max_pd(ax, ay);
+  // atan2(0, 0) is 0
+  __m512d t = _mm512_maskz_div_pd(
+      _mm512_cmp_pd_mask(max, zero, _CMP_NEQ_UQ), _mm512_min_pd(ax, ay), max);
+
+  __m512d r = atan_unit_avx512(t);
+  r = _mm512_mask_sub_pd(r, _mm512_cmp_pd_mask(ay, ax, _CMP_GT_OQ),
+                         _mm512_set1_pd(PI_A / 2), r);
+  r = _mm512_mask_sub_pd(r, _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ),
+                         _mm512_set1_pd(PI_A), r);
+  return _mm512_mask_sub_pd(r, _mm512_cmp_pd_mask(y, zero, _CMP_LT_OQ), zero,
+                            r);
+}
+
+AVX512 static inline __m512d chord_distance_avx512(__m512d dx, __m512d dy,
+                                                   __m512d dz, __m512d dalt) {
+  __m512d one = _mm512_set1_pd(1);
+  __m512d a = _mm512_mul_pd(
+      _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz))),
+      _mm512_set1_pd(0.25));
+  a = _mm512_min_pd(a, one);
+  __m512d c = _mm512_mul_pd(
+      _mm512_set1_pd(2),
+      atan2_avx512(_mm512_sqrt_pd(a), _mm512_sqrt_pd(_mm512_sub_pd(one, a))));
+  __m512d arc = _mm512_mul_pd(_mm512_set1_pd(R), c);
+  return _mm512_sqrt_pd(_mm512_fmadd_pd(arc, arc, _mm512_mul_pd(dalt, dalt)));
+}
+
+AVX512 static KERNEL_INLINE void kernel_avx512(
+    tail_table_t *table, int *slots, unsigned int count, double *point,
+    gate_t *gate, double *bound, uint8_t *compatible, double *distance,
+    double *angle, unsigned int gates) {
+  double **columns = table->columns;
+  __m512d zero = _mm512_setzero_pd();
+  __m512d lat = _mm512_set1_pd(point[LAT]);
+  __m512d lon = _mm512_set1_pd(point[LON]);
+  __m512d alt = _mm512_set1_pd(point[ALT]);
+  __m512d epoch = _mm512_set1_pd(point[EPOCH]);
+  __m512d x = _mm512_set1_pd(gate->unit[0]);
+  __m512d y = _mm512_set1_pd(gate->unit[1]);
+  __m512d z = _mm512_set1_pd(gate->unit[2]);
+  __m512d distance_threshold = _mm512_set1_pd(gate->distance_threshold);
+  __m512d time_threshold = _mm512_set1_pd(gate->time_threshold);
+  __m512d angle_threshold = _mm512_set1_pd(gate->angle_diff_threshold);
+  __m512d speed_threshold = _mm512_set1_pd(gate->speed_diff_threshold);
+  __m512d distance_error = _mm512_set1_pd(
+      KERNEL_TOLERANCE * gate->distance_threshold + KERNEL_DISTANCE_ERROR);
+  __m512d angle_error = _mm512_set1_pd(
+      KERNEL_TOLERANCE * gate->angle_diff_threshold + KERNEL_ANGLE_ERROR);
+
+  for (unsigned int i = 0; i < count; i += 8) {
+    unsigned int lanes = count - i < 8 ? count - i : 8;
+    __mmask8 valid = (__mmask8)((1u << lanes) - 1);
+    int indices[8];
+
+    // the missing lanes of the last block repeat a valid slot
+    for (unsigned int j = 0; j < 8; j++) {
+      indices[j] = slots[i + (j < lanes ? j : 0)];
+    }
+
+    __m256i index = _mm256_loadu_si256((__m256i *)indices);
+#define GATHER(column) _mm512_i32gather_pd(index, columns[column], 8)
+
+    __m512d elapsed = zero;
+    __mmask8 in_time = valid;
+
+    if ((gates & KERNEL_GATE_TIME) || gate->motion) {
+      elapsed = _mm512_sub_pd(epoch, GATHER(TAIL_EPOCH));
+    }
+
+    // the time gate is exact and costs a subtraction, so it goes first
+    if (gates & KERNEL_GATE_TIME) {
+      in_time &= _mm512_cmp_pd_mask(_mm512_abs_pd(elapsed), time_threshold,
+                                    _CMP_LE_OQ);
+
+      if (in_time == 0) {
+        memset(compatible + i, FALSE, lanes);
+        continue;
+      }
+    }
+
+    __m512d tail_x = GATHER(TAIL_X);
+    __m512d tail_y = GATHER(TAIL_Y);
+    __m512d tail_z = GATHER(TAIL_Z);
+    __m512d tail_alt = GATHER(TAIL_ALT);
+
+    __m512d threshold = distance_threshold;
+    __m512d error = distance_error;
+
+    if (gate->motion) {
+      threshold = GATHER(DISTANCE_GATE);
+      error = _mm512_fmadd_pd(threshold, _mm512_set1_pd(KERNEL_TOLERANCE),
+                              _mm512_set1_pd(KERNEL_DISTANCE_ERROR));
+      tail_x = _mm512_fmadd_pd(GATHER(VELOCITY_X), elapsed, tail_x);
+      tail_y = _mm512_fmadd_pd(GATHER(VELOCITY_Y), elapsed, tail_y);
+      tail_z = _mm512_fmadd_pd(GATHER(VELOCITY_Z), elapsed, tail_z);
+      tail_alt = _mm512_fmadd_pd(GATHER(VELOCITY_ALT), elapsed, tail_alt);
+    }
+
+    __m512d range = _mm512_add_pd(threshold, error);
+    __m512d tail_distance = chord_distance_avx512(
+        _mm512_sub_pd(x, tail_x), _mm512_sub_pd(y, tail_y),
+        _mm512_sub_pd(z, tail_z), _mm512_sub_pd(alt, tail_alt));
+
+    // the score is at least the distance, so the lanes farther than the best
+    // score can not win and their windows are not evaluated
+    __mmask8 in_range = _mm512_mask_cmp_pd_mask(in_time, tail_distance,
+                                                range, _CMP_LE_OQ);
+    double best = bound != NULL ? *bound : INFINITY;
+    __mmask8 live = _mm512_mask_cmp_pd_mask(
+        in_range, tail_distance,
+        _mm512_add_pd(_mm512_set1_pd(best), error), _CMP_LE_OQ);
+
+    if (live == 0) {
+      for (unsigned int j = 0; j < lanes; j++) {
+        compatible[i + j] = (in_range >> j) & 1 ? KERNEL_PRUNED : FALSE;
+      }
+
+      continue;
+    }
+
+    __m512d mean_dlat = _mm512_sub_pd(lat, GATHER(MEAN_LAT));
+    __m512d mean_dlon = _mm512_sub_pd(lon, GATHER(MEAN_LON));
+    __m512d speed_diff = speed_threshold;
+    __m512d speed_error = zero;
+
+    if (gates & KERNEL_GATE_SPEED) {
+      __m512d mean_distance = chord_distance_avx512(
+          _mm512_sub_pd(x, GATHER(MEAN_X)), _mm512_sub_pd(y, GATHER(MEAN_Y)),
+          _mm512_sub_pd(z, GATHER(MEAN_Z)),
+          _mm512_sub_pd(alt, GATHER(MEAN_ALT)));
+      __m512d mean_time = _mm512_sub_pd(epoch, GATHER(MEAN_EPOCH));
+      __mmask8 has_time = _mm512_cmp_pd_mask(mean_time, zero, _CMP_NEQ_UQ);
+      __m512d speed = _mm512_maskz_div_pd(has_time, mean_distance, mean_time);
+      speed_error = _mm512_maskz_div_pd(
+          has_time,
+          _mm512_fmadd_pd(mean_distance, _mm512_set1_pd(KERNEL_TOLERANCE),
+                          _mm512_set1_pd(KERNEL_DISTANCE_ERROR)),
+          _mm512_abs_pd(mean_time));
+      speed_diff = _mm512_abs_pd(_mm512_sub_pd(GATHER(GENERAL_SPEED), speed));
+    }
+
+    __m512d angle_diff = _mm512_abs_pd(_mm512_sub_pd(
+        GATHER(GENERAL_ANGLE),
+        _mm512_div_pd(_mm512_mul_pd(atan2_avx512(mean_dlat, mean_dlon),
+                                    _mm512_set1_pd(180)),
+                      _mm512_set1_pd(PI))));
+
+    // clusters smaller than the window pass the speed and angle gates
+    __mmask8 ready =
+        _mm512_cmp_pd_mask(GATHER(WINDOW_READY), zero, _CMP_NEQ_OQ);
+    speed_diff = _mm512_mask_blend_pd(ready, speed_threshold, speed_diff);
+    angle_diff = _mm512_mask_blend_pd(ready, angle_threshold, angle_diff);
+#undef GATHER
+
+    __mmask8 pass =
+        _mm512_cmp_pd_mask(tail_distance, threshold, _CMP_LE_OQ) &
+        _mm512_cmp_pd_mask(angle_diff, angle_threshold, _CMP_LE_OQ) & in_time;
+    __mmask8 near_window = _mm512_cmp_pd_mask(
+        _mm512_abs_pd(_mm512_sub_pd(angle_diff, angle_threshold)), angle_error,
+        _CMP_LE_OQ);
+
+    if (gates & KERNEL_GATE_SPEED) {
+      pass &= _mm512_cmp_pd_mask(speed_diff, speed_threshold, _CMP_LE_OQ);
+      near_window |= _mm512_cmp_pd_mask(
+          _mm512_abs_pd(_mm512_sub_pd(speed_diff, speed_threshold)),
+          speed_error, _CMP_LE_OQ);
+    }
+
+    __mmask8 near =
+        _mm512_cmp_pd_mask(
+            _mm512_abs_pd(_mm512_sub_pd(tail_distance, threshold)),
+            error, _CMP_LE_OQ) |
+        (ready & near_window);
+
+    double lane_distance[8];
+    double lane_angle[8];
+    _mm512_storeu_pd(lane_distance, tail_distance);
+    _mm512_storeu_pd(lane_angle, angle_diff);
+
+    for (unsigned int j = 0; j < lanes; j++) {
+      if (!((live >> j) & 1)) {
+        compatible[i + j] = (in_range >> j) & 1 ? KERNEL_PRUNED : FALSE;
+        continue;
+      }
+
+      distance[i + j] = lane_distance[j];
+      angle[i + j] = lane_angle[j];
+      compatible[i + j] = (pass >> j) & 1;
+
+      if ((near >> j) & 1) {
+        evaluate_exact(columns, indices[j], point, gate, &compatible[i + j],
+                       &distance[i + j], &angle[i + j]);
+      }
+
+      update_bound(bound, compatible[i + j], distance[i + j], angle[i + j]);
+    }
+  }
+}
+
+KERNEL_VARIANTS(kernel_avx512, AVX512)
+
+#endif
+
+unsigned int kernel_gates(double time_threshold, double speed_diff_threshold) {
+  return (time_threshold != INFINITY ? KERNEL_GATE_TIME : 0) |
+         (speed_diff_threshold != INFINITY ? KERNEL_GATE_SPEED : 0);
+}
+
+compatibility_kernel_t select_compatibility_kernel(int isa, unsigned int gates,
+                                                   int *selected) {
+#ifdef KERNEL_X86
+  __builtin_cpu_init();
+
+  if ((isa == KERNEL_AUTO || isa == KERNEL_AVX512) &&
+      __builtin_cpu_supports("avx512f")) {
+    *selected = KERNEL_AVX512;
+    return kernel_avx512_variants[gates];
+  }
+
+  if ((isa == KERNEL_AUTO || isa == KERNEL_AVX512 || isa == KERNEL_AVX2) &&
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    *selected = KERNEL_AVX2;
+    return kernel_avx2_variants[gates];
+  }
+#endif
+
+  *selected = KERNEL_SCALAR;
+  return kernel_scalar_variants[gates];
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef SIMD_KERNEL_H
+#define SIMD_KERNEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the kernels measure distances by the chord between the earth centered unit
+// vectors and the vector kernels use their own atan2, the results agree with
+// `haversine_distance` to about 1e-8 meters and with `angle_degree` to a
+// relative error of about 1e-13. a gate whose value is within
+// KERNEL_TOLERANCE of the threshold (relative), KERNEL_DISTANCE_ERROR meters or
+// KERNEL_ANGLE_ERROR degrees of it is evaluated again with the exact
+// functions, so every kernel decides the gates like `check_compatibility`
+#define KERNEL_TOLERANCE 1e-9
+#define KERNEL_DISTANCE_ERROR 1e-6
+#define KERNEL_ANGLE_ERROR 1e-9
+
+enum kernel_isa { KERNEL_AUTO, KERNEL_SCALAR, KERNEL_AVX2, KERNEL_AVX512 };
+
+// gates that are compiled into a kernel, a gate whose threshold is INFINITY
+// passes every finite point so the kernels without it skip it entirely. the
+// angle is part of the score of a candidate and is always evaluated
+enum kernel_gates {
+  KERNEL_GATE_TIME = 1,
+  KERNEL_GATE_SPEED = 2,
+  KERNEL_GATES = 4
+};
+
+// compatibility of a candidate that passed the time and distance gates but is
+// farther than the best score so far, so it can not be the closest cluster and
+// its angle and speed were not evaluated
+#define KERNEL_PRUNED 2
+
+enum tail_columns {
+  TAIL_LAT,
+  TAIL_LON,
+  TAIL_ALT,
+  TAIL_EPOCH,
+  TAIL_X,
+  TAIL_Y,
+  TAIL_Z,
+  MEAN_LAT,
+  MEAN_LON,
+  MEAN_ALT,
+  MEAN_EPOCH,
+  MEAN_X,
+  MEAN_Y,
+  MEAN_Z,
+  GENERAL_SPEED,
+  GENERAL_ANGLE,
+  WINDOW_READY,
+  // change of the unit vector and the altitude per second, zero unless the
+  // motion gate is on and the cluster has points at two epochs
+  VELOCITY_X,
+  VELOCITY_Y,
+  VELOCITY_Z,
+  VELOCITY_ALT,
+  // distance threshold of the slot, the motion threshold for the clusters
+  // with a velocity
+  DISTANCE_GATE,
+  TAIL_COLUMNS
+};
+
+/// structure of arrays copy of what the gates need from every cluster slot:
+/// the last point, the first half mean of the window with their earth centered
+/// unit vectors, the general diffs and the velocity
+typedef struct tail_table_s {
+  double* columns[TAIL_COLUMNS];
+  unsigned int capacity;
+} tail_table_t;
+
+typedef struct gate_s {
+  double distance_threshold;
+  double time_threshold;
+  double angle_diff_threshold;
+  double speed_diff_threshold;
+  // earth centered unit vector of the point the gates are evaluated for
+  double unit[3];
+  // TRUE to measure the distance to the last point moved by the velocity of
+  // the cluster to the epoch of the point, against the `DISTANCE_GATE` of the
+  // cluster instead of `distance_threshold`
+  uint8_t motion;
+} gate_t;
+
+/// @brief evaluate the time, distance, speed and angle gates of one point
+/// against many cluster slots, the time gate first and the speed and angle
+/// gates only for the candidates that can still beat the best score
+/// @param table tail table of the clusters
+/// @param slots slots to evaluate
+/// @param count number of slots
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @param gate thresholds of the gates
+/// @param bound pointer to the best `sqrt(distance^2 + angle^2)` score so far,
+/// lowered as closer compatible candidates are found, NULL to evaluate every
+/// candidate
+/// @param compatible result array, TRUE where every gate passed, FALSE where
+/// one failed and KERNEL_PRUNED where the candidate can not win
+/// @param distance result array of haversine distances, set where compatible
+/// @param angle result array of angle differences, set where compatible
+typedef void (*compatibility_kernel_t)(tail_table_t* table, int* slots,
+                                       unsigned int count, double* point,
+                                       gate_t* gate, double* bound,
+                                       uint8_t* compatible, double* distance,
+                                       double* angle);
+
+/// @brief get the distance the distance gate compares, the haversine distance
+/// to the last point or with the motion gate the chord distance to the last
+/// point moved to the epoch of the point
+/// @param table tail table of the clusters
+/// @param slot slot of the cluster
+/// @param point contiguous LAT, LON, ALT, EPOCH values of the point
+/// @param gate gates of the point
+/// @return the distance in meters
+double gate_distance(tail_table_t* table, int slot, double* point,
+                     gate_t* gate);
+
+/// @brief get the gates the kernels have to evaluate for a set of thresholds
+/// @param time_threshold maximum time difference
+/// @param speed_diff_threshold maximum speed difference
+/// @return combination of `kernel_gates`
+unsigned int kernel_gates(double time_threshold, double speed_diff_threshold);
+
+/// @brief get the best kernel the cpu supports
+/// @param isa requested instruction set, KERNEL_AUTO for the best one
+/// @param gates combination of `kernel_gates` the kernel evaluates
+/// @param selected pointer to the instruction set of the returned kernel
+/// @return the kernel, never wider than the requested instruction set
+compatibility_kernel_t select_compatibility_kernel(int isa, unsigned int gates,
+                                                   int* selected);
+
+/// @brief make room for `capacity` slots in the table
+/// @param table table to grow
+/// @param capacity number of slots
+void tail_table_reserve(tail_table_t* table, unsigned int capacity);
+
+/// @brief free the table storage
+/// @param table table to free
+void tail_table_free(tail_table_t* table);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "agglomerative.h"
+
+static unsigned int cell_hash(int32_t* cell) {
+  return ((uint32_t)cell[0] * 73856093u) ^ ((uint32_t)cell[1] * 19349663u) ^
+         ((uint32_t)cell[2] * 83492791u);
+}
+
+static uint8_t same_cell(int32_t* first, int32_t* second) {
+  return first[0] == second[0] && first[1] == second[1] &&
+         first[2] == second[2];
+}
+
+static void link_slot(spatial_grid_t *grid, int slot) {
+  unsigned int bucket = cell_hash(grid->slot_cell[slot]) & grid->bucket_mask;
+
+  grid->slot_prev[slot] = -1;
+  grid->slot_next[slot] = grid->buckets[bucket];
+
+  if (grid->buckets[bucket] != -1) {
+    grid->slot_prev[grid->buckets[bucket]] = slot;
+  }
+
+  grid->buckets[bucket] = slot;
+}
+
+static void unlink_slot(spatial_grid_t *grid, int slot) {
+  if (grid->slot_prev[slot] != -1) {
+    grid->slot_next[grid->slot_prev[slot]] = grid->slot_next[slot];
+  } else {
+    unsigned int bucket = cell_hash(grid->slot_cell[slot]) & grid->bucket_mask;
+    grid->buckets[bucket] = grid->slot_next[slot];
+  }
+
+  if (grid->slot_next[slot] != -1) {
+    grid->slot_prev[grid->slot_next[slot]] = grid->slot_prev[slot];
+  }
+}
+
+static void rehash(spatial_grid_t *grid, unsigned int bucket_count) {
+  int *old_buckets = grid->buckets;
+  unsigned int old_count = grid->bucket_mask + 1;
+
+  grid->buckets = (int *)malloc(sizeof(int) * bucket_count);
+  memset(grid->buckets, -1, sizeof(int) * bucket_count);
+  grid->bucket_mask = bucket_count - 1;
+
+  for (unsigned int i = 0; i < old_count; i++) {
+    int slot = old_buckets[i];
+
+    while (slot != -1) {
+      int next = grid->slot_next[slot];
+      link_slot(grid, slot);
+      slot = next;
+    }
+  }
+
+  free(old_buckets);
+}
+
+uint8_t spatial_grid_reset(spatial_grid_t *grid, double distance_threshold) {
+  grid->len = 0;
+
+  // past a fraction of the earth radius every point is a neighbor anyway
+  if (!(distance_threshold < R / 4)) {
+    return 0;
+  }
+
+  // a small margin keeps points right at the threshold out of rounding trouble
+  grid->cell_size = fmax(distance_threshold * (1 + 1e-9) + 1e-6,
+                         GRID_MIN_CELL_SIZE);
+
+  if (grid->buckets == NULL) {
+    grid->buckets = (int *)malloc(sizeof(int) * 64);
+    grid->bucket_mask = 63;
+  }
+
+  memset(grid->buckets, -1, sizeof(int) * (grid->bucket_mask + 1));
+
+  return 1;
+}
+
+void spatial_grid_free(spatial_grid_t *grid) {
+  free(grid->buckets);
+  free(grid->slot_cell);
+  free(grid->slot_next);
+  free(grid->slot_prev);
+  free(grid->candidates);
+  memset(grid, 0, sizeof(spatial_grid_t));
+}
+
+void spatial_grid_reserve(spatial_grid_t *grid, unsigned int capacity) {
+  if (capacity <= grid->slot_capacity) {
+    return;
+  }
+
+  grid->slot_cell =
+      (int32_t(*)[3])realloc(grid->slot_cell, sizeof(int32_t[3]) * capacity);
+  grid->slot_next = (int *)realloc(grid->slot_next, sizeof(int) * capacity);
+  grid->slot_prev = (int *)realloc(grid->slot_prev, sizeof(int) * capacity);
+  grid->slot_capacity = capacity;
+}
+
+int32_t *spatial_grid_cell(spatial_grid_t *grid, double *unit) {
+  double scale = R / grid->cell_size;
+
+  for (unsigned int i = 0; i < 3; i++) {
+    grid->cell[i] = (int32_t)floor(unit[i] * scale);
+  }
+
+  return grid->cell;
+}
+
+void spatial_grid_insert(spatial_grid_t *grid, int slot, int32_t *cell) {
+  if (grid->len + 1 > grid->bucket_mask + 1) {
+    rehash(grid, (grid->bucket_mask + 1) * 2);
+  }
+
+  memcpy(grid->slot_cell[slot], cell, sizeof(int32_t[3]));
+  link_slot(grid, slot);
+  grid->len++;
+}
+
+void spatial_grid_remove(spatial_grid_t *grid, int slot) {
+  unlink_slot(grid, slot);
+  grid->len--;
+}
+
+void spatial_grid_move(spatial_grid_t *grid, int slot, int32_t *cell) {
+  if (same_cell(grid->slot_cell[slot], cell)) {
+    return;
+  }
+
+  unlink_slot(grid, slot);
+  memcpy(grid->slot_cell[slot], cell, sizeof(int32_t[3]));
+  link_slot(grid, slot);
+}
+
+unsigned int spatial_grid_query(spatial_grid_t *grid, int32_t *cell) {
+  grid->candidates_len = 0;
+
+  for (int i = 0; i < GRID_NEIGHBORS; i++) {
+    int32_t neighbor[3] = {cell[0] + i % 3 - 1, cell[1] + (i / 3) % 3 - 1,
+                           cell[2] + i / 9 - 1};
+    int slot = grid->buckets[cell_hash(neighbor) & grid->bucket_mask];
+
+    for (; slot != -1; slot = grid->slot_next[slot]) {
+      // different cells can share a bucket
+      if (!same_cell(grid->slot_cell[slot], neighbor)) {
+        continue;
+      }
+
+      if (grid->candidates_len == grid->candidates_capacity) {
+        grid->candidates_capacity =
+            grid->candidates_capacity ? grid->candidates_capacity * 2 : 64;
+        grid->candidates = (int *)realloc(
+            grid->candidates, sizeof(int) * grid->candidates_capacity);
+      }
+
+      grid->candidates[grid->candidates_len++] = slot;
+    }
+  }
+
+  return grid->candidates_len;
+}
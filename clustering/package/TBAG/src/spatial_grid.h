@@ -0,0 +1,78 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_MIN_CELL_SIZE 1.0
+#define GRID_NEIGHBORS 27
+
+typedef struct spatial_grid_s {
+  double cell_size;
+  // cell of the last point handed to `spatial_grid_cell`
+  int32_t cell[3];
+  int* buckets;
+  unsigned int bucket_mask;
+  unsigned int len;
+  unsigned int slot_capacity;
+  int32_t (*slot_cell)[3];
+  int* slot_next;
+  int* slot_prev;
+  int* candidates;
+  unsigned int candidates_len;
+  unsigned int candidates_capacity;
+} spatial_grid_t;
+
+/// @brief remove every slot from the grid and set a new threshold, the
+/// storage of the grid is kept. the cells are cubes over the earth centered
+/// coordinates of the points, two points closer than `distance_threshold` by
+/// haversine are always in neighboring cells because the chord is shorter than
+/// the arc
+/// @param grid grid to reset, a zeroed grid starts empty
+/// @param distance_threshold maximum distance between a point and a cluster
+/// @return boolean value indicating if the grid can prune the threshold
+uint8_t spatial_grid_reset(spatial_grid_t* grid, double distance_threshold);
+
+/// @brief free the grid storage
+/// @param grid grid to free
+void spatial_grid_free(spatial_grid_t* grid);
+
+/// @brief make room for slots up to `capacity`
+/// @param grid grid to grow
+/// @param capacity number of slots
+void spatial_grid_reserve(spatial_grid_t* grid, unsigned int capacity);
+
+/// @brief get the cell of a point
+/// @param grid grid to use
+/// @param unit earth centered unit vector of the point
+/// @return pointer to the three cell coordinates, valid until the next call
+int32_t* spatial_grid_cell(spatial_grid_t* grid, double* unit);
+
+/// @brief add a slot to the grid
+/// @param grid grid to add to
+/// @param slot slot to add
+/// @param cell cell of the slot
+void spatial_grid_insert(spatial_grid_t* grid, int slot, int32_t* cell);
+
+/// @brief remove a slot from the grid
+/// @param grid grid to remove from
+/// @param slot slot to remove
+void spatial_grid_remove(spatial_grid_t* grid, int slot);
+
+/// @brief move a slot to a new cell if it changed
+/// @param grid grid to update
+/// @param slot slot to move
+/// @param cell new cell of the slot
+void spatial_grid_move(spatial_grid_t* grid, int slot, int32_t* cell);
+
+/// @brief collect the slots in the cell and its neighbors into
+/// `grid->candidates`
+/// @param grid grid to query
+/// @param cell cell of the queried point
+/// @return the number of candidates
+unsigned int spatial_grid_query(spatial_grid_t* grid, int32_t* cell);
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,522 @@
+#include "spatial_tiles.h"
+
+void agglomerative_clustering_tiled(
+    double *data, unsigned int height, ptrdiff_t row_stride,
+    ptrdiff_t col_stride, double tile_size, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int threads,
+    int *res) {
+  clustering_params_t params = {distance_threshold, time_threshold,
+                                angle_diff_threshold, speed_diff_threshold,
+                                window_size};
+  tile_plan_t plan;
+
+  if (height == 0) {
+    return;
+  }
+
+#ifdef _OPENMP
+  if (threads <= 0) {
+    threads = omp_get_max_threads();
+  }
+#else
+  (void)threads;
+#endif
+
+  tile_plan_build(&plan, data, height, row_stride, col_stride, tile_size,
+                  distance_threshold);
+
+  uint32_t *links = (uint32_t *)malloc(sizeof(uint32_t) * plan.tiles);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    spatial_grid_t grid;
+
+    memset(&grid, 0, sizeof(spatial_grid_t));
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+    for (int i = 0; i < (int)plan.tiles; i++) {
+      links[i] = link_tile(&grid, &plan, i, data, row_stride, col_stride,
+                           distance_threshold, time_threshold);
+    }
+
+    spatial_grid_free(&grid);
+  }
+
+  group_tiles(&plan, links);
+
+  int *labels = (int *)malloc(sizeof(int) * height);
+  unsigned int *clusters =
+      (unsigned int *)malloc(sizeof(unsigned int) * plan.groups);
+
+  // the busiest groups go first so the quiet ones fill up the threads at the
+  // end, like the scenes of `agglomerative_clustering_batch`
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+  {
+    clustering_state_t *arena =
+        clustering_init(distance_threshold, time_threshold,
+                        angle_diff_threshold, speed_diff_threshold,
+                        window_size);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (int i = 0; i < (int)plan.groups; i++) {
+      clusters[i] = cluster_tile_group(arena, &plan, i, data, row_stride,
+                                       col_stride, &params,
+                                       labels + plan.group_offsets[i]);
+    }
+
+    clustering_destroy(arena);
+  }
+
+  reconcile_tiles(&plan, height, labels, clusters, res);
+
+  free(clusters);
+  free(labels);
+  free(links);
+  tile_plan_free(&plan);
+}
+
+void tile_plan_build(tile_plan_t *plan, double *data, unsigned int height,
+                     ptrdiff_t row_stride, ptrdiff_t col_stride,
+                     double tile_size, double distance_threshold) {
+  // a small margin keeps points right at the threshold out of rounding
+  // trouble, like the cells of the spatial grid
+  double halo = distance_threshold * (1 + 1e-9) + 1e-6;
+  unsigned int len = 0;
+  unsigned int capacity = height + height / 4 + 16;
+  tile_entry_t *entries =
+      (tile_entry_t *)malloc(sizeof(tile_entry_t) * capacity);
+  double point[WIDTH];
+
+  // a halo reaches the neighboring tiles only
+  plan->tile_size = fmax(fmax(tile_size, halo), GRID_MIN_CELL_SIZE);
+
+  for (unsigned int i = 0; i < height; i++) {
+    double *row = data + (ptrdiff_t)i * row_stride;
+    double unit[3];
+    int32_t cell[3];
+    // distance to the lower and upper face of the tile on every axis
+    double faces[3][3];
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    ecef_unit(point, unit);
+
+    for (unsigned int k = 0; k < 3; k++) {
+      double position = unit[k] * R;
+
+      cell[k] = (int32_t)floor(position / plan->tile_size);
+      faces[k][0] = position - cell[k] * plan->tile_size;
+      faces[k][1] = 0;
+      faces[k][2] = (cell[k] + 1) * plan->tile_size - position;
+    }
+
+    // the chord between two points is shorter than their distance, so a
+    // point is a halo point of every tile its position is within the halo of
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+          double gap = pow(faces[0][dx + 1] * (dx != 0), 2) +
+                       pow(faces[1][dy + 1] * (dy != 0), 2) +
+                       pow(faces[2][dz + 1] * (dz != 0), 2);
+
+          if (gap > halo * halo) {
+            continue;
+          }
+
+          if (len == capacity) {
+            capacity *= 2;
+            entries = (tile_entry_t *)realloc(
+                entries, sizeof(tile_entry_t) * capacity);
+          }
+
+          tile_entry_t *entry = &entries[len++];
+          entry->tile[0] = cell[0] + dx;
+          entry->tile[1] = cell[1] + dy;
+          entry->tile[2] = cell[2] + dz;
+          entry->index = i;
+          entry->neighbor = (1 - dx) * 9 + (1 - dy) * 3 + 1 - dz;
+        }
+      }
+    }
+  }
+
+  qsort(entries, len, sizeof(tile_entry_t), compare_tile_entries);
+
+  plan->members = entries;
+  plan->tiles = 0;
+  plan->offsets = (unsigned int *)malloc(sizeof(unsigned int) * (len + 1));
+
+  for (unsigned int i = 0; i < len; i++) {
+    if (i == 0 || memcmp(entries[i].tile, entries[i - 1].tile,
+                         sizeof(entries[i].tile)) != 0) {
+      plan->offsets[plan->tiles++] = i;
+    }
+  }
+
+  plan->offsets[plan->tiles] = len;
+  plan->groups = 0;
+  plan->group_offsets = NULL;
+  plan->points = NULL;
+}
+
+void tile_plan_free(tile_plan_t *plan) {
+  free(plan->offsets);
+  free(plan->members);
+  free(plan->group_offsets);
+  free(plan->points);
+  plan->offsets = NULL;
+  plan->members = NULL;
+  plan->group_offsets = NULL;
+  plan->points = NULL;
+  plan->tiles = 0;
+  plan->groups = 0;
+}
+
+uint32_t link_tile(spatial_grid_t *grid, tile_plan_t *plan, unsigned int tile,
+                   double *data, ptrdiff_t row_stride, ptrdiff_t col_stride,
+                   double distance_threshold, double time_threshold) {
+  tile_entry_t *members = plan->members + plan->offsets[tile];
+  unsigned int len = plan->offsets[tile + 1] - plan->offsets[tile];
+  // the chord between two points is shorter than their distance, with the
+  // margin of the halos
+  double halo = distance_threshold * (1 + 1e-9) + 1e-6;
+  double reach = halo / R;
+  uint32_t links = 0;
+
+  // past a fraction of the earth radius every halo point is a neighbor
+  if (!spatial_grid_reset(grid, halo)) {
+    for (unsigned int i = 0; i < len; i++) {
+      links |= (uint32_t)1 << members[i].neighbor;
+    }
+
+    return links & ~((uint32_t)1 << TILE_CORE);
+  }
+
+  spatial_grid_reserve(grid, len);
+
+  double *units = (double *)malloc(sizeof(double[3]) * len);
+  double *epochs = (double *)malloc(sizeof(double) * len);
+  uint8_t *inserted = (uint8_t *)malloc(sizeof(uint8_t) * len);
+  unsigned int oldest = 0;
+
+  for (unsigned int i = 0; i < len; i++) {
+    double *row = data + (ptrdiff_t)members[i].index * row_stride;
+    double point[WIDTH];
+    double *unit = units + (size_t)i * 3;
+    uint8_t core = members[i].neighbor == TILE_CORE;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    epochs[i] = point[EPOCH];
+    inserted[i] = FALSE;
+
+    // the members are in input order, so the ones too old for a cluster to
+    // span the gap to this point come first
+    while (oldest < i && epochs[i] - epochs[oldest] > time_threshold) {
+      if (inserted[oldest]) {
+        spatial_grid_remove(grid, oldest);
+      }
+
+      oldest++;
+    }
+
+    // a halo point of a tile that is linked already cannot add a link
+    if (!core && (links >> members[i].neighbor & 1)) {
+      continue;
+    }
+
+    ecef_unit(point, unit);
+
+    // and a core point further than the halo from every face of the tile
+    // cannot reach a halo point
+    if (core) {
+      double face = INFINITY;
+
+      for (unsigned int k = 0; k < 3; k++) {
+        double position = unit[k] * R - members[i].tile[k] * plan->tile_size;
+
+        face = fmin(face, fmin(position, plan->tile_size - position));
+      }
+
+      if (face > halo) {
+        continue;
+      }
+    }
+
+    int32_t *cell = spatial_grid_cell(grid, unit);
+    unsigned int candidates = spatial_grid_query(grid, cell);
+
+    for (unsigned int j = 0; j < candidates; j++) {
+      unsigned int other = (unsigned int)grid->candidates[j];
+      uint8_t neighbor = core ? members[other].neighbor : members[i].neighbor;
+      double *other_unit = units + (size_t)other * 3;
+
+      // a link is between a core point and a halo point, two halo points
+      // are checked by the tiles they are in
+      if ((members[other].neighbor == TILE_CORE) == core ||
+          (links >> neighbor & 1)) {
+        continue;
+      }
+
+      double chord = pow(unit[0] - other_unit[0], 2) +
+                     pow(unit[1] - other_unit[1], 2) +
+                     pow(unit[2] - other_unit[2], 2);
+
+      if (chord <= reach * reach) {
+        links |= (uint32_t)1 << neighbor;
+      }
+    }
+
+    spatial_grid_insert(grid, i, cell);
+    inserted[i] = TRUE;
+  }
+
+  free(inserted);
+  free(epochs);
+  free(units);
+  return links;
+}
+
+static int compare_indices(const void *first, const void *second) {
+  unsigned int first_index = *(const unsigned int *)first;
+  unsigned int second_index = *(const unsigned int *)second;
+
+  return (first_index > second_index) - (first_index < second_index);
+}
+
+void group_tiles(tile_plan_t *plan, uint32_t *links) {
+  int *parent = (int *)malloc(sizeof(int) * (plan->tiles + 1));
+
+  for (unsigned int i = 0; i < plan->tiles; i++) {
+    parent[i] = i;
+  }
+
+  for (unsigned int i = 0; i < plan->tiles; i++) {
+    int32_t *tile = plan->members[plan->offsets[i]].tile;
+
+    for (unsigned int j = 0; j < TILE_NEIGHBORS; j++) {
+      if (!(links[i] >> j & 1)) {
+        continue;
+      }
+
+      int32_t neighbor[3] = {tile[0] + (int32_t)(j / 9) - 1,
+                             tile[1] + (int32_t)(j / 3 % 3) - 1,
+                             tile[2] + (int32_t)(j % 3) - 1};
+      int own = find_root(parent, i);
+      int other = find_root(parent, find_tile(plan, neighbor));
+
+      // the lower root is kept so the groups do not depend on the link order
+      if (own < other) {
+        parent[other] = own;
+      } else {
+        parent[own] = other;
+      }
+    }
+  }
+
+  // a tile with points in it belongs to the group of its root
+  int *group = (int *)malloc(sizeof(int) * (plan->tiles + 1));
+  scene_order_t *order =
+      (scene_order_t *)malloc(sizeof(scene_order_t) * (plan->tiles + 1));
+
+  plan->groups = 0;
+
+  for (unsigned int i = 0; i < plan->tiles; i++) {
+    group[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < plan->tiles; i++) {
+    unsigned int len = 0;
+
+    for (unsigned int j = plan->offsets[i]; j < plan->offsets[i + 1]; j++) {
+      len += plan->members[j].neighbor == TILE_CORE;
+    }
+
+    if (len == 0) {
+      continue;
+    }
+
+    int root = find_root(parent, i);
+
+    if (group[root] == -1) {
+      group[root] = plan->groups;
+      order[plan->groups].len = 0;
+      order[plan->groups].scene = plan->groups;
+      plan->groups++;
+    }
+
+    order[group[root]].len += len;
+  }
+
+  qsort(order, plan->groups, sizeof(scene_order_t), compare_scene_order);
+
+  // the groups are stored busiest first
+  unsigned int *rank =
+      (unsigned int *)malloc(sizeof(unsigned int) * (plan->groups + 1));
+
+  plan->group_offsets =
+      (unsigned int *)malloc(sizeof(unsigned int) * (plan->groups + 1));
+  plan->group_offsets[0] = 0;
+
+  for (unsigned int i = 0; i < plan->groups; i++) {
+    rank[order[i].scene] = i;
+    plan->group_offsets[i + 1] = plan->group_offsets[i] + order[i].len;
+  }
+
+  unsigned int *cursor =
+      (unsigned int *)malloc(sizeof(unsigned int) * (plan->groups + 1));
+
+  memcpy(cursor, plan->group_offsets, sizeof(unsigned int) * plan->groups);
+  plan->points = (unsigned int *)malloc(
+      sizeof(unsigned int) * (plan->group_offsets[plan->groups] + 1));
+
+  for (unsigned int i = 0; i < plan->tiles; i++) {
+    for (unsigned int j = plan->offsets[i]; j < plan->offsets[i + 1]; j++) {
+      if (plan->members[j].neighbor == TILE_CORE) {
+        plan->points[cursor[rank[group[find_root(parent, i)]]]++] =
+            plan->members[j].index;
+      }
+    }
+  }
+
+  // the points of every tile are in input order, the ones of a group are
+  // put back in it
+  for (unsigned int i = 0; i < plan->groups; i++) {
+    qsort(plan->points + plan->group_offsets[i],
+          plan->group_offsets[i + 1] - plan->group_offsets[i],
+          sizeof(unsigned int), compare_indices);
+  }
+
+  free(cursor);
+  free(rank);
+  free(order);
+  free(group);
+  free(parent);
+}
+
+int find_tile(tile_plan_t *plan, int32_t *tile) {
+  int low = 0;
+  int high = (int)plan->tiles - 1;
+
+  // the tiles are sorted by their cube
+  while (low <= high) {
+    int middle = low + (high - low) / 2;
+    int32_t *other = plan->members[plan->offsets[middle]].tile;
+    int comparison = 0;
+
+    for (unsigned int i = 0; i < 3 && comparison == 0; i++) {
+      comparison = (other[i] > tile[i]) - (other[i] < tile[i]);
+    }
+
+    if (comparison == 0) {
+      return middle;
+    }
+
+    if (comparison < 0) {
+      low = middle + 1;
+    } else {
+      high = middle - 1;
+    }
+  }
+
+  return -1;
+}
+
+unsigned int cluster_tile_group(clustering_state_t *arena, tile_plan_t *plan,
+                                unsigned int group, double *data,
+                                ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                clustering_params_t *params, int *labels) {
+  unsigned int *points = plan->points + plan->group_offsets[group];
+  unsigned int len =
+      plan->group_offsets[group + 1] - plan->group_offsets[group];
+  double *rows = (double *)malloc(sizeof(double[WIDTH]) * (len + 1));
+  int clusters = 0;
+
+  // the points are in input order, so they are still sorted by epoch
+  for (unsigned int i = 0; i < len; i++) {
+    double *row = data + (ptrdiff_t)points[i] * row_stride;
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      rows[(size_t)i * WIDTH + j] = row[(ptrdiff_t)j * col_stride];
+    }
+  }
+
+  agglomerative_clustering_strided(
+      arena, rows, len, WIDTH, 1, params->distance_threshold,
+      params->time_threshold, params->angle_diff_threshold,
+      params->speed_diff_threshold, params->window_size, labels);
+
+  for (unsigned int i = 0; i < len; i++) {
+    clusters = labels[i] + 1 > clusters ? labels[i] + 1 : clusters;
+  }
+
+  free(rows);
+  return (unsigned int)clusters;
+}
+
+void reconcile_tiles(tile_plan_t *plan, unsigned int height, int *labels,
+                     unsigned int *clusters, int *res) {
+  int *first = (int *)malloc(sizeof(int) * (plan->groups + 1));
+
+  first[0] = 0;
+
+  for (unsigned int i = 0; i < plan->groups; i++) {
+    first[i + 1] = first[i] + (int)clusters[i];
+  }
+
+  // every point is in exactly one group, its cluster there is the cluster of
+  // the point
+  for (unsigned int i = 0; i < plan->groups; i++) {
+    for (unsigned int j = plan->group_offsets[i];
+         j < plan->group_offsets[i + 1]; j++) {
+      res[plan->points[j]] = first[i] + labels[j];
+    }
+  }
+
+  // the global ids are given in the order the clusters first appear, like
+  // the ids of a single pass
+  int *names = (int *)malloc(sizeof(int) * (first[plan->groups] + 1));
+  int next_name = 0;
+
+  for (int i = 0; i < first[plan->groups]; i++) {
+    names[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    if (names[res[i]] == -1) {
+      names[res[i]] = next_name++;
+    }
+
+    res[i] = names[res[i]];
+  }
+
+  free(names);
+  free(first);
+}
+
+int compare_tile_entries(const void *first, const void *second) {
+  const tile_entry_t *first_entry = (const tile_entry_t *)first;
+  const tile_entry_t *second_entry = (const tile_entry_t *)second;
+
+  for (unsigned int i = 0; i < 3; i++) {
+    if (first_entry->tile[i] != second_entry->tile[i]) {
+      return first_entry->tile[i] < second_entry->tile[i] ? -1 : 1;
+    }
+  }
+
+  return (first_entry->index > second_entry->index) -
+         (first_entry->index < second_entry->index);
+}
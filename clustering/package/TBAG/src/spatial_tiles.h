@@ -0,0 +1,139 @@
+#ifndef SPATIAL_TILES_H
+#define SPATIAL_TILES_H
+
+#include "agglomerative.h"
+
+// offset of the tile a point is in from the tile of an entry,
+// (dx + 1) * 9 + (dy + 1) * 3 + dz + 1
+#define TILE_CORE 13
+#define TILE_NEIGHBORS 27
+
+typedef struct tile_entry_s {
+  // cube of the earth centered coordinates the tile covers
+  int32_t tile[3];
+  // index of the point in the input
+  unsigned int index;
+  // TILE_CORE in the tile the point is in, the offset of that tile in the
+  // tiles it is a halo point of
+  uint8_t neighbor;
+} tile_entry_t;
+
+/// every tile is a cube of the earth centered grid with the points in it and
+/// the halo points within `distance_threshold` of it. a point can only join a
+/// cluster whose last point is within `distance_threshold` and
+/// `time_threshold` of it, so the tiles are linked when one of their points
+/// comes that close to a point of the other, and a group of linked tiles is
+/// clustered on its own like a part of a single pass
+typedef struct tile_plan_s {
+  double tile_size;
+  unsigned int tiles;
+  // members of tile `i` are `members[offsets[i]]` up to
+  // `members[offsets[i + 1]]` in input order
+  unsigned int* offsets;
+  tile_entry_t* members;
+  unsigned int groups;
+  // points of group `i` are `points[group_offsets[i]]` up to
+  // `points[group_offsets[i + 1]]` in input order, the busiest group first
+  unsigned int* group_offsets;
+  unsigned int* points;
+} tile_plan_t;
+
+/// @brief cluster data points like `agglomerative_clustering_strided` in
+/// groups of spatial tiles on a pool of threads
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points, sorted by epoch ascending
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param tile_size width of the tiles in meters, at least
+/// `distance_threshold`
+/// @param threads number of threads, 0 or less for one per core
+/// @param res result array, the ids are given in the order the clusters first
+/// appear like in a single pass
+/// @details the tiles whose points come within `distance_threshold` and
+/// `time_threshold` of each other across a border are clustered together, so
+/// the labels are the ones of a single pass. the more engagements cross the
+/// borders the fewer groups there are to run in parallel
+void agglomerative_clustering_tiled(
+    double* data, unsigned int height, ptrdiff_t row_stride,
+    ptrdiff_t col_stride, double tile_size, double distance_threshold,
+    double time_threshold, double angle_diff_threshold,
+    double speed_diff_threshold, unsigned int window_size, int threads,
+    int* res);
+
+/// @brief split points into tiles with their halos
+/// @param plan plan to build
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param tile_size width of the tiles in meters
+/// @param distance_threshold width of the halos in meters
+void tile_plan_build(tile_plan_t* plan, double* data, unsigned int height,
+                     ptrdiff_t row_stride, ptrdiff_t col_stride,
+                     double tile_size, double distance_threshold);
+
+/// @brief free the members and groups of a tile plan
+/// @param plan tile plan
+void tile_plan_free(tile_plan_t* plan);
+
+/// @brief find the neighboring tiles whose points can join a cluster of a
+/// tile or the other way around, sweeping the members in epoch order on a
+/// spatial grid
+/// @param grid caller owned grid to reuse
+/// @param plan tile plan
+/// @param tile index of the tile
+/// @param data pointer to the LAT value of the first point
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param distance_threshold maximum distance of a point to the last point
+/// of a cluster
+/// @param time_threshold maximum time of a point after the last point of a
+/// cluster
+/// @return bit `i` set for the neighboring tile at offset `i`
+uint32_t link_tile(spatial_grid_t* grid, tile_plan_t* plan, unsigned int tile,
+                   double* data, ptrdiff_t row_stride, ptrdiff_t col_stride,
+                   double distance_threshold, double time_threshold);
+
+/// @brief join the linked tiles into groups and collect the points of every
+/// group
+/// @param plan tile plan
+/// @param links neighboring tiles linked to every tile, see `link_tile`
+void group_tiles(tile_plan_t* plan, uint32_t* links);
+
+/// @brief find a tile of a plan by its cube
+/// @param plan tile plan
+/// @param tile cube of the earth centered coordinates
+/// @return index of the tile, -1 if no point is in it or in its halo
+int find_tile(tile_plan_t* plan, int32_t* tile);
+
+/// @brief cluster the points of one group of tiles
+/// @param arena caller owned state to reuse, NULL to use a temporary state
+/// @param plan tile plan
+/// @param group index of the group
+/// @param data pointer to the LAT value of the first point
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param params clustering parameters
+/// @param labels result array of the cluster ids in the group of its points
+/// @return number of clusters in the group
+unsigned int cluster_tile_group(clustering_state_t* arena, tile_plan_t* plan,
+                                unsigned int group, double* data,
+                                ptrdiff_t row_stride, ptrdiff_t col_stride,
+                                clustering_params_t* params, int* labels);
+
+/// @brief label every point with the global id of its cluster in its group
+/// @param plan tile plan
+/// @param height number of data points
+/// @param labels cluster ids in their group of all the points of the plan
+/// @param clusters number of clusters of every group
+/// @param res result array of the global cluster ids
+void reconcile_tiles(tile_plan_t* plan, unsigned int height, int* labels,
+                     unsigned int* clusters, int* res);
+
+/// @brief order tile entries by tile, then by point
+/// @param first first entry
+/// @param second second entry
+/// @return qsort comparison result
+int compare_tile_entries(const void* first, const void* second);
+
+#endif
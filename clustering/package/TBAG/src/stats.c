@@ -0,0 +1,45 @@
+#include "stats.h"
+
+#if defined(WIN32) || defined(_WIN32) || \
+    defined(__WIN32) && !defined(__CYGWIN__)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+double stats_clock(void) {
+#if defined(WIN32) || defined(_WIN32) || \
+    defined(__WIN32) && !defined(__CYGWIN__)
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+void stats_lap(double *phase, double *clock) {
+  double now = stats_clock();
+
+  *phase += now - *clock;
+  *clock = now;
+}
+
+void stats_add_candidates(clustering_stats_t *stats, unsigned int count) {
+  unsigned int bucket = 0;
+
+  for (unsigned int rest = count;
+       rest > 0 && bucket < STATS_HISTOGRAM_BUCKETS - 1; rest >>= 1) {
+    bucket++;
+  }
+
+  stats->candidates_histogram[bucket]++;
+  stats->compatibility_checks += count;
+}
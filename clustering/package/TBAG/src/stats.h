@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// points are bucketed by the log2 of their candidate count
+#define STATS_HISTOGRAM_BUCKETS 18
+
+// building with TBAG_NO_STATS removes every stats branch from the hot path,
+// otherwise a state without stats costs one predictable branch per phase
+#ifdef TBAG_NO_STATS
+#define STATS_ENABLED(state) 0
+#else
+#define STATS_ENABLED(state) ((state)->stats != NULL)
+#endif
+
+typedef struct clustering_stats_s {
+  uint64_t points;
+  uint64_t clusters_created;
+  uint64_t clusters_finished;
+  // points by number of candidate clusters, bucket 0 counts the points with
+  // no candidate, bucket i the points with 2^(i-1) to 2^i - 1 candidates and
+  // the last bucket every larger count
+  uint64_t candidates_histogram[STATS_HISTOGRAM_BUCKETS];
+  // candidates evaluated with the rules of `check_compatibility`
+  uint64_t compatibility_checks;
+  uint64_t compatible;
+  // candidates past the time and distance gates that were farther than the
+  // best score so far, their angle and speed were not evaluated in the search
+  uint64_t pruned;
+  // a rejected candidate counts once for every gate it fails
+  uint64_t rejected_distance;
+  uint64_t rejected_time;
+  uint64_t rejected_angle;
+  uint64_t rejected_speed;
+  // seconds finding the closest compatible cluster of the points
+  double search_seconds;
+  // seconds adding the points to their clusters and creating new clusters
+  double append_seconds;
+  // seconds closing stale clusters and handing out their labels
+  double label_seconds;
+} clustering_stats_t;
+
+/// @brief monotonic clock for the phase timers
+/// @return seconds from an arbitrary start
+double stats_clock(void);
+
+/// @brief add the time since the last lap to a phase
+/// @param phase pointer to the seconds of the phase
+/// @param clock pointer to the time of the last lap, set to now
+void stats_lap(double* phase, double* clock);
+
+/// @brief count the candidates of one point
+/// @param stats stats to update
+/// @param count number of candidates
+void stats_add_candidates(clustering_stats_t* stats, unsigned int count);
+
+#endif
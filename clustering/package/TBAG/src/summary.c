@@ -0,0 +1,107 @@
+#include "agglomerative.h"
+
+void summary_add_point(cluster_summary_t *summary, double *previous,
+                       double *point) {
+  if (previous == NULL) {
+    memset(summary, 0, sizeof(cluster_summary_t));
+    summary->first_epoch = point[EPOCH];
+    summary->min_lat = summary->max_lat = point[LAT];
+    summary->min_lon = summary->max_lon = point[LON];
+    summary->min_alt = summary->max_alt = point[ALT];
+  } else {
+    double step = haversine_distance(previous, point);
+
+    summary->path_length += step;
+
+    if (step > 0) {
+      double east = (point[LON] - previous[LON]) * cos(point[LAT]);
+      double north = point[LAT] - previous[LAT];
+      double norm = sqrt(east * east + north * north);
+
+      if (norm > 0) {
+        summary->heading_east += east / norm;
+        summary->heading_north += north / norm;
+      }
+    }
+
+    summary->min_lat = fmin(summary->min_lat, point[LAT]);
+    summary->max_lat = fmax(summary->max_lat, point[LAT]);
+    summary->min_lon = fmin(summary->min_lon, point[LON]);
+    summary->max_lon = fmax(summary->max_lon, point[LON]);
+    summary->min_alt = fmin(summary->min_alt, point[ALT]);
+    summary->max_alt = fmax(summary->max_alt, point[ALT]);
+  }
+
+  summary->len++;
+  summary->last_epoch = point[EPOCH];
+}
+
+void summary_finish(cluster_summary_t *summary) {
+  double duration = summary->last_epoch - summary->first_epoch;
+
+  summary->mean_speed = duration > 0 ? summary->path_length / duration : 0;
+  summary->heading =
+      summary->heading_east == 0 && summary->heading_north == 0
+          ? 0
+          : atan2(summary->heading_north, summary->heading_east) * 180 / PI;
+}
+
+void summarize_clusters(double *data, unsigned int height,
+                        ptrdiff_t row_stride, ptrdiff_t col_stride, int *res,
+                        unsigned int clusters, cluster_summary_t *summaries) {
+  size_t len = clusters > 0 ? clusters : 1;
+  uint8_t *seen = (uint8_t *)calloc(len, sizeof(uint8_t));
+  // the last point of every cluster so far
+  double(*last)[WIDTH] = (double(*)[WIDTH])malloc(sizeof(double[WIDTH]) * len);
+
+  for (unsigned int i = 0; i < height; i++) {
+    double point[WIDTH];
+    double *row = data + (ptrdiff_t)i * row_stride;
+    int id = res[i];
+
+    if (id < 0) {
+      continue;
+    }
+
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      point[j] = row[(ptrdiff_t)j * col_stride];
+    }
+
+    summary_add_point(&summaries[id], seen[id] ? last[id] : NULL, point);
+    memcpy(last[id], point, sizeof(point));
+    seen[id] = TRUE;
+  }
+
+  for (unsigned int i = 0; i < clusters; i++) {
+    summary_finish(&summaries[i]);
+  }
+
+  free(last);
+  free(seen);
+}
+
+void cluster_membership(int *res, unsigned int height, unsigned int clusters,
+                        unsigned int *offsets, unsigned int *indices) {
+  memset(offsets, 0, sizeof(unsigned int) * (clusters + 1));
+
+  for (unsigned int i = 0; i < height; i++) {
+    offsets[res[i] + 1] += res[i] >= 0;
+  }
+
+  for (unsigned int i = 0; i < clusters; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+
+  // the offsets are used as the write positions and shifted back after
+  for (unsigned int i = 0; i < height; i++) {
+    if (res[i] >= 0) {
+      indices[offsets[res[i]]++] = i;
+    }
+  }
+
+  for (unsigned int i = clusters; i > 0; i--) {
+    offsets[i] = offsets[i - 1];
+  }
+
+  offsets[0] = 0;
+}
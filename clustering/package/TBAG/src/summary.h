@@ -0,0 +1,68 @@
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct cluster_summary_s {
+  unsigned int len;
+  double first_epoch;
+  double last_epoch;
+  // bounding box of the points, the lat and lon in radians
+  double min_lat;
+  double max_lat;
+  double min_lon;
+  double max_lon;
+  double min_alt;
+  double max_alt;
+  // meters along the path between consecutive points
+  double path_length;
+  // path length over the duration of the cluster, 0 for a single epoch
+  double mean_speed;
+  // circular mean of the headings of the steps in degrees counterclockwise
+  // from east, 0 for a cluster that never moved
+  double heading;
+  // sums of the east and north components of the unit steps
+  double heading_east;
+  double heading_north;
+} cluster_summary_t;
+
+/// @brief add the next point of a cluster to its summary
+/// @param summary summary of the cluster
+/// @param previous the last point of the cluster before this one, NULL for the
+/// first point of the cluster
+/// @param point the new point of the cluster
+void summary_add_point(cluster_summary_t* summary, double* previous,
+                       double* point);
+
+/// @brief fill in the mean speed and heading of a summary from its sums
+/// @param summary summary of the cluster
+void summary_finish(cluster_summary_t* summary);
+
+/// @brief summarize the clusters of a pass from its labels, for the labels
+/// that were not produced by a state collecting summaries
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @param res cluster ids of the points, the points without a cluster (-1)
+/// are left out
+/// @param clusters number of clusters, one more than the largest id
+/// @param summaries array of `clusters` summaries to fill
+void summarize_clusters(double* data, unsigned int height,
+                        ptrdiff_t row_stride, ptrdiff_t col_stride, int* res,
+                        unsigned int clusters, cluster_summary_t* summaries);
+
+/// @brief group the points by cluster in compressed sparse row form, the
+/// points of cluster `i` are `indices[offsets[i]]` up to
+/// `indices[offsets[i + 1]]` in stream order
+/// @param res cluster ids of the points, the points without a cluster (-1)
+/// are left out
+/// @param height number of data points
+/// @param clusters number of clusters, one more than the largest id
+/// @param offsets array of `clusters + 1` offsets to fill
+/// @param indices array of `height` point indices to fill
+void cluster_membership(int* res, unsigned int height, unsigned int clusters,
+                        unsigned int* offsets, unsigned int* indices);
+
+#endif
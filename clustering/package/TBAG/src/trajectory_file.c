@@ -0,0 +1,305 @@
+#include "trajectory_file.h"
+
+#if !(defined(WIN32) || defined(_WIN32) || \
+      defined(__WIN32) && !defined(__CYGWIN__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int agglomerative_clustering_file(const char *path, const char *labels_path,
+                                  double distance_threshold,
+                                  double time_threshold,
+                                  double angle_diff_threshold,
+                                  double speed_diff_threshold,
+                                  unsigned int window_size, int threads) {
+  mapped_file_t input;
+  mapped_file_t output;
+
+  if (!map_file(&input, path, 0, FALSE)) {
+    return TRAJECTORY_FILE_IO;
+  }
+
+  trajectory_header_t *header = trajectory_file_header(&input);
+
+  if (header == NULL) {
+    unmap_file(&input);
+    return TRAJECTORY_FILE_FORMAT;
+  }
+
+  unsigned int height = (unsigned int)header->points;
+
+  // an empty run still leaves an empty labels file behind
+  if (!map_file(&output, labels_path, sizeof(int) * (size_t)height, TRUE)) {
+    unmap_file(&input);
+    return TRAJECTORY_FILE_IO;
+  }
+
+  clustering_state_t *state =
+      clustering_init(distance_threshold, time_threshold, angle_diff_threshold,
+                      speed_diff_threshold, window_size);
+
+  if (state == NULL) {
+    unmap_file(&output);
+    unmap_file(&input);
+    return TRAJECTORY_FILE_MEMORY;
+  }
+
+  double *columns[WIDTH];
+  int *res = (int *)output.data;
+  double previous_epoch = -INFINITY;
+  int error = TRAJECTORY_FILE_OK;
+
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    columns[j] = (double *)(input.data + header->column_offset[j]);
+  }
+
+  clustering_set_threads(state, threads);
+  state->emit_finished = FALSE;
+
+  for (unsigned int begin = 0; begin < height && error == TRAJECTORY_FILE_OK;
+       begin += TRAJECTORY_FILE_CHUNK) {
+    unsigned int end = height - begin < TRAJECTORY_FILE_CHUNK
+                           ? height
+                           : begin + TRAJECTORY_FILE_CHUNK;
+    double point[WIDTH];
+
+    for (unsigned int i = begin; i < end; i++) {
+      for (unsigned int j = 0; j < WIDTH; j++) {
+        point[j] = columns[j][i];
+      }
+
+      if (point[EPOCH] < previous_epoch) {
+        error = TRAJECTORY_FILE_UNSORTED;
+        break;
+      }
+
+      previous_epoch = point[EPOCH];
+      res[i] = clustering_push_point(state, point);
+    }
+
+    // the columns are read front to back, so everything before the chunk end
+    // is done with
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      release_mapped_range(&input, header->column_offset[j],
+                           header->column_offset[j] + sizeof(double) * end);
+    }
+
+    release_mapped_range(&output, 0, sizeof(int) * (size_t)end);
+  }
+
+  clustering_flush(state);
+  clustering_destroy(state);
+  unmap_file(&output);
+  unmap_file(&input);
+
+  return error;
+}
+
+int trajectory_file_write(const char *path, double *data, unsigned int height,
+                          ptrdiff_t row_stride, ptrdiff_t col_stride) {
+  trajectory_header_t header;
+  FILE *file = fopen(path, "wb");
+
+  if (file == NULL) {
+    return TRAJECTORY_FILE_IO;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRAJECTORY_FILE_MAGIC, sizeof(header.magic));
+  header.version = TRAJECTORY_FILE_VERSION;
+  header.columns = WIDTH;
+  header.points = height;
+
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    header.column_offset[j] =
+        TRAJECTORY_FILE_HEADER_SIZE + sizeof(double) * (uint64_t)height * j;
+  }
+
+  uint8_t written = fwrite(&header, sizeof(header), 1, file) == 1;
+  double buffer[1024];
+
+  for (unsigned int j = 0; j < WIDTH && written; j++) {
+    for (unsigned int begin = 0; begin < height && written; begin += 1024) {
+      unsigned int count = height - begin < 1024 ? height - begin : 1024;
+
+      for (unsigned int i = 0; i < count; i++) {
+        buffer[i] = data[(ptrdiff_t)(begin + i) * row_stride +
+                         (ptrdiff_t)j * col_stride];
+      }
+
+      written = fwrite(buffer, sizeof(double), count, file) == count;
+    }
+  }
+
+  if (fclose(file) != 0 || !written) {
+    return TRAJECTORY_FILE_IO;
+  }
+
+  return TRAJECTORY_FILE_OK;
+}
+
+trajectory_header_t *trajectory_file_header(mapped_file_t *file) {
+  if (file->size < sizeof(trajectory_header_t)) {
+    return NULL;
+  }
+
+  trajectory_header_t *header = (trajectory_header_t *)file->data;
+
+  if (memcmp(header->magic, TRAJECTORY_FILE_MAGIC, sizeof(header->magic)) !=
+          0 ||
+      header->version != TRAJECTORY_FILE_VERSION ||
+      header->columns != WIDTH || header->points > UINT_MAX) {
+    return NULL;
+  }
+
+  for (unsigned int j = 0; j < WIDTH; j++) {
+    uint64_t offset = header->column_offset[j];
+
+    if (offset % sizeof(double) != 0 || offset < sizeof(trajectory_header_t) ||
+        offset > file->size ||
+        (file->size - offset) / sizeof(double) < header->points) {
+      return NULL;
+    }
+  }
+
+  return header;
+}
+
+#if defined(WIN32) || defined(_WIN32) || \
+    defined(__WIN32) && !defined(__CYGWIN__)
+uint8_t map_file(mapped_file_t *file, const char *path, size_t size,
+                 uint8_t writable) {
+  LARGE_INTEGER file_size;
+
+  file->data = NULL;
+  file->mapping = NULL;
+  file->file = CreateFileA(
+      path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+      FILE_SHARE_READ, NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+  if (file->file == INVALID_HANDLE_VALUE) {
+    return FALSE;
+  }
+
+  if (!writable) {
+    if (!GetFileSizeEx(file->file, &file_size)) {
+      CloseHandle(file->file);
+      return FALSE;
+    }
+
+    size = (size_t)file_size.QuadPart;
+  }
+
+  file->size = size;
+
+  // an empty file can not be mapped, it has nothing to read or write anyway
+  if (size == 0) {
+    return TRUE;
+  }
+
+  file->mapping = CreateFileMappingA(
+      file->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+      (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xffffffff), NULL);
+
+  if (file->mapping != NULL) {
+    file->data = (uint8_t *)MapViewOfFile(
+        file->mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+  }
+
+  if (file->data == NULL) {
+    unmap_file(file);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void unmap_file(mapped_file_t *file) {
+  if (file->data != NULL) {
+    UnmapViewOfFile(file->data);
+  }
+
+  if (file->mapping != NULL) {
+    CloseHandle(file->mapping);
+  }
+
+  CloseHandle(file->file);
+  file->data = NULL;
+  file->mapping = NULL;
+}
+
+void release_mapped_range(mapped_file_t *file, size_t begin, size_t end) {
+  // the working set trimmer takes the pages of the view back under pressure
+  (void)file;
+  (void)begin;
+  (void)end;
+}
+#else
+uint8_t map_file(mapped_file_t *file, const char *path, size_t size,
+                 uint8_t writable) {
+  struct stat file_stat;
+
+  file->data = NULL;
+  file->fd = writable ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)
+                      : open(path, O_RDONLY);
+
+  if (file->fd < 0) {
+    return FALSE;
+  }
+
+  if (writable ? ftruncate(file->fd, (off_t)size) != 0
+               : fstat(file->fd, &file_stat) != 0) {
+    close(file->fd);
+    return FALSE;
+  }
+
+  file->size = writable ? size : (size_t)file_stat.st_size;
+
+  // an empty file can not be mapped, it has nothing to read or write anyway
+  if (file->size == 0) {
+    return TRUE;
+  }
+
+  void *data = mmap(NULL, file->size, writable ? PROT_READ | PROT_WRITE
+                                               : PROT_READ,
+                    MAP_SHARED, file->fd, 0);
+
+  if (data == MAP_FAILED) {
+    close(file->fd);
+    return FALSE;
+  }
+
+  file->data = (uint8_t *)data;
+  madvise(file->data, file->size, MADV_SEQUENTIAL);
+
+  return TRUE;
+}
+
+void unmap_file(mapped_file_t *file) {
+  if (file->data != NULL) {
+    munmap(file->data, file->size);
+  }
+
+  close(file->fd);
+  file->data = NULL;
+}
+
+void release_mapped_range(mapped_file_t *file, size_t begin, size_t end) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  // only whole pages inside the range are released
+  begin = (begin + page - 1) / page * page;
+  end = end / page * page;
+
+  if (file->data == NULL || begin >= end) {
+    return;
+  }
+
+  // the mapping is shared, so written pages stay in the page cache and reach
+  // the file, only this process lets go of them
+  madvise(file->data + begin, end - begin, MADV_DONTNEED);
+}
+#endif
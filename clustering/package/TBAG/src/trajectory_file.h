@@ -0,0 +1,113 @@
+#ifndef TRAJECTORY_FILE_H
+#define TRAJECTORY_FILE_H
+
+#if defined(WIN32) || defined(_WIN32) || \
+    defined(__WIN32) && !defined(__CYGWIN__)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <limits.h>
+
+#include "agglomerative.h"
+
+// a trajectory file is a 64 byte header followed by the LAT, LON, ALT and
+// EPOCH columns of the points as little endian doubles, every column holds
+// `points` values sorted by epoch ascending. the labels file of a run is a
+// bare column of `points` native ints
+#define TRAJECTORY_FILE_MAGIC "TBAGTRJ1"
+#define TRAJECTORY_FILE_VERSION 1
+#define TRAJECTORY_FILE_HEADER_SIZE 64
+// points between two releases of the pages that were already clustered
+#define TRAJECTORY_FILE_CHUNK (1u << 20)
+
+enum trajectory_file_error {
+  TRAJECTORY_FILE_OK = 0,
+  // the file could not be opened, created or mapped
+  TRAJECTORY_FILE_IO = -1,
+  // the header is not one of a trajectory file or the columns do not fit
+  TRAJECTORY_FILE_FORMAT = -2,
+  // the epochs are not sorted, the labels up to the first unsorted point are
+  // written
+  TRAJECTORY_FILE_UNSORTED = -3,
+  // the clustering state could not be allocated
+  TRAJECTORY_FILE_MEMORY = -4,
+};
+
+typedef struct trajectory_header_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t columns;
+  uint64_t points;
+  // byte offsets of the LAT, LON, ALT and EPOCH columns from the start of the
+  // file, each a multiple of 8
+  uint64_t column_offset[WIDTH];
+  uint8_t reserved[TRAJECTORY_FILE_HEADER_SIZE - 24 - 8 * WIDTH];
+} trajectory_header_t;
+
+typedef struct mapped_file_s {
+  uint8_t* data;
+  size_t size;
+#if defined(WIN32) || defined(_WIN32) || \
+    defined(__WIN32) && !defined(__CYGWIN__)
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+} mapped_file_t;
+
+/// @brief cluster the points of a trajectory file like
+/// `agglomerative_clustering` without reading it into memory, the file is
+/// mapped and streamed in epoch order and the labels are written to a mapped
+/// labels file, the pages that were clustered are released as the run goes so
+/// the memory is bounded by the open clusters rather than the file size
+/// @param path path of the trajectory file
+/// @param labels_path path of the labels file to create or overwrite
+/// @param threads number of threads evaluating the candidates, see
+/// `clustering_set_threads`
+/// @return one of `trajectory_file_error`
+int agglomerative_clustering_file(const char* path, const char* labels_path,
+                                  double distance_threshold,
+                                  double time_threshold,
+                                  double angle_diff_threshold,
+                                  double speed_diff_threshold,
+                                  unsigned int window_size, int threads);
+
+/// @brief write points to a trajectory file
+/// @param path path of the file to create or overwrite
+/// @param data pointer to the LAT value of the first point
+/// @param height number of data points, sorted by epoch ascending
+/// @param row_stride number of doubles between two consecutive points
+/// @param col_stride number of doubles between two consecutive columns
+/// @return one of `trajectory_file_error`
+int trajectory_file_write(const char* path, double* data, unsigned int height,
+                          ptrdiff_t row_stride, ptrdiff_t col_stride);
+
+/// @brief check the header of a mapped trajectory file
+/// @param file mapped file
+/// @return the header, NULL if the file is not a valid trajectory file
+trajectory_header_t* trajectory_file_header(mapped_file_t* file);
+
+/// @brief map a file into memory
+/// @param file mapping to fill
+/// @param path path of the file
+/// @param size size of a new file, ignored when reading
+/// @param writable TRUE to create the file and map it for writing, FALSE to
+/// map an existing file for reading
+/// @return boolean value indicating if the file was mapped
+uint8_t map_file(mapped_file_t* file, const char* path, size_t size,
+                 uint8_t writable);
+
+/// @brief unmap a file mapped with `map_file`
+/// @param file mapped file
+void unmap_file(mapped_file_t* file);
+
+/// @brief hand the pages of a range that will not be touched again back to
+/// the system, written pages are kept by the file
+/// @param file mapped file
+/// @param begin first byte of the range
+/// @param end byte after the range
+void release_mapped_range(mapped_file_t* file, size_t begin, size_t end);
+
+#endif
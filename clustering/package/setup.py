@@ -1,8 +1,27 @@
+import platform
+
 import setuptools
 
 with open("README.md", "r") as fh:
     long_description = fh.read()
 
+ext_modules = []
+
+# the native module releases the GIL while clustering and reads numpy arrays in place, the ctypes library stays the
+# fallback where it is not built
+if platform.system() != 'Windows':
+    ext_modules.append(setuptools.Extension(
+        'TBAG._tbag',
+        sources=['TBAG/src/_tbag_module.c', 'TBAG/src/agglomerative.c', 'TBAG/src/spatial_grid.c',
+                 'TBAG/src/simd_kernel.c', 'TBAG/src/stats.c', 'TBAG/src/fragment_merge.c',
+                 'TBAG/src/trajectory_file.c', 'TBAG/src/summary.c', 'TBAG/src/reorder_buffer.c',
+                 'TBAG/src/scan_batch.c', 'TBAG/src/spatial_tiles.c',
+                 'TBAG/src/csv_loader.c'],
+        extra_compile_args=['-O3', '-fopenmp'],
+        extra_link_args=['-fopenmp'],
+        libraries=['m'],
+    ))
+
 setuptools.setup(
     name="TBAG",
     version="0.0.4",
@@ -14,10 +33,12 @@ setuptools.setup(
     packages=setuptools.find_packages(),
     include_package_data=True,
     package_data={'TBAG': ['lib/trajectory_clustering.dll']},
+    ext_modules=ext_modules,
     classifiers=[
         "Programming Language :: Python :: 3",
         "License :: OSI Approved :: MIT License",
         "Operating System :: Windows",
+        "Operating System :: POSIX :: Linux",
     ],
     python_requires='>=3.8',
 )
@@ -0,0 +1,180 @@
+#ifndef TEST_SCENE_H
+#define TEST_SCENE_H
+
+#include "agglomerative.h"
+
+#define SCENE_LAT 0.5585
+#define SCENE_LON 0.5934
+#define SCENE_EPOCH 1.6716e9
+
+// checks of a test, `scene_expect` counts the ones that fail
+static unsigned int scene_failures = 0;
+
+static uint64_t scene_rng;
+
+static inline double scene_uniform(void) {
+  scene_rng ^= scene_rng << 13;
+  scene_rng ^= scene_rng >> 7;
+  scene_rng ^= scene_rng << 17;
+  return (scene_rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double scene_normal(void) {
+  return sqrt(-2 * log(scene_uniform() + 1e-300)) *
+         cos(2 * PI * scene_uniform());
+}
+
+typedef struct scene_params_s {
+  // number of projectiles
+  unsigned int tracks;
+  // seconds over which the projectiles start
+  double duration;
+  // seconds a projectile is tracked
+  double track_duration;
+  // side of the square the projectiles start in, in meters
+  double area;
+  // standard deviation of the position error in meters
+  double noise;
+  // seconds of missing plots in the middle of every track, 0 for none
+  double dropout;
+  // seconds between the scans the epochs are rounded down to, 0 to keep the
+  // epoch of every plot
+  double scan;
+  uint64_t seed;
+} scene_params_t;
+
+static inline int scene_compare_epoch(const void *first,
+                                      const void *second) {
+  const double *first_point = (const double *)first;
+  const double *second_point = (const double *)second;
+
+  if (first_point[EPOCH] != second_point[EPOCH]) {
+    return first_point[EPOCH] < second_point[EPOCH] ? -1 : 1;
+  }
+
+  // the track keeps the order of the points of a scan the same on every run
+  return (first_point[WIDTH] > second_point[WIDTH]) -
+         (first_point[WIDTH] < second_point[WIDTH]);
+}
+
+/// @brief generate an epoch sorted scene of straight projectiles that start
+/// in a square around the scene center and cross each other, like the scenes
+/// of the benchmark
+/// @param params scene parameters
+/// @param height pointer to the number of generated points
+/// @param tracks result array of the projectile of every point, allocated by
+/// the call, NULL to skip it
+/// @return row major array of the points
+static inline double *scene_generate(scene_params_t *params,
+                                     unsigned int *height, int **tracks) {
+  unsigned int capacity = 1024;
+  unsigned int len = 0;
+  double(*rows)[WIDTH + 1] =
+      (double(*)[WIDTH + 1])malloc(sizeof(double[WIDTH + 1]) * capacity);
+
+  scene_rng = params->seed * 2654435761u + 88172645463325252ull;
+
+  for (unsigned int i = 0; i < params->tracks; i++) {
+    double speed = 50 + scene_uniform() * 500;
+    double heading = scene_uniform() * 2 * PI;
+    double climb = (scene_uniform() - 0.5) * 40;
+    double start = scene_uniform() * params->duration;
+    double north = (scene_uniform() - 0.5) * params->area;
+    double east = (scene_uniform() - 0.5) * params->area;
+    double alt = scene_uniform() * 3000;
+    double dropout = (params->track_duration - params->dropout) / 2;
+
+    for (double t = 0; t < params->track_duration;
+         t += 0.8 + 0.4 * scene_uniform()) {
+      if (t >= dropout && t < dropout + params->dropout) {
+        continue;
+      }
+
+      if (len == capacity) {
+        capacity *= 2;
+        rows = (double(*)[WIDTH + 1])realloc(
+            rows, sizeof(double[WIDTH + 1]) * capacity);
+      }
+
+      double *row = rows[len++];
+      row[LAT] = SCENE_LAT + (north + speed * t * cos(heading) +
+                              scene_normal() * params->noise) /
+                                 R;
+      row[LON] = SCENE_LON + (east + speed * t * sin(heading) +
+                              scene_normal() * params->noise) /
+                                 (R * cos(SCENE_LAT));
+      row[ALT] = alt + climb * t + scene_normal() * params->noise;
+      row[EPOCH] = SCENE_EPOCH + start + t;
+      row[WIDTH] = i;
+
+      if (params->scan > 0) {
+        row[EPOCH] = floor(row[EPOCH] / params->scan) * params->scan;
+      }
+    }
+  }
+
+  qsort(rows, len, sizeof(double[WIDTH + 1]), scene_compare_epoch);
+
+  double *points = (double *)malloc(sizeof(double[WIDTH]) * len);
+
+  if (tracks != NULL) {
+    *tracks = (int *)malloc(sizeof(int) * len);
+  }
+
+  for (unsigned int i = 0; i < len; i++) {
+    memcpy(points + (size_t)i * WIDTH, rows[i], sizeof(double[WIDTH]));
+
+    if (tracks != NULL) {
+      (*tracks)[i] = (int)rows[i][WIDTH];
+    }
+  }
+
+  free(rows);
+
+  *height = len;
+  return points;
+}
+
+/// @brief count the points whose labels differ, the ids of every entry point
+/// are given in order of first appearance so equal partitions have equal
+/// labels
+/// @param name name of the check
+/// @param expected labels of a single pass
+/// @param labels labels to check
+/// @param height number of points
+/// @return the number of differing points
+static inline unsigned int scene_compare(const char *name, int *expected,
+                                         int *labels, unsigned int height) {
+  unsigned int diffs = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    diffs += expected[i] != labels[i];
+  }
+
+  if (diffs > 0) {
+    printf("FAIL %s: %u of %u labels differ\n", name, diffs, height);
+    scene_failures++;
+  }
+
+  return diffs;
+}
+
+/// @brief check a condition of a test
+/// @param name name of the check
+/// @param condition boolean value indicating if the check passed
+static inline void scene_expect(const char *name, int condition) {
+  if (!condition) {
+    printf("FAIL %s\n", name);
+    scene_failures++;
+  }
+}
+
+/// @brief report the checks of a test
+/// @param test name of the test
+/// @return exit status of the test
+static inline int scene_report(const char *test) {
+  printf("%s: %s\n", test, scene_failures ? "FAILED" : "ok");
+  return scene_failures ? 1 : 0;
+}
+
+#endif
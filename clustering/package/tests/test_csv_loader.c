@@ -0,0 +1,117 @@
+#include <time.h>
+
+#include "csv_loader.h"
+#include "scene.h"
+
+#define CSV_PATH "test_csv_loader.csv"
+
+typedef struct known_epoch_s {
+  const char *field;
+  double epoch;
+} known_epoch_t;
+
+// the timestamps are read like `pd.to_datetime` reads them
+int main(void) {
+  known_epoch_t known[] = {
+      {"1970-01-01", 0},
+      {"1969-12-31T23:59:59", -1},
+      {"2000-02-29T23:59:59Z", 951868799},
+      {"2024-02-29 12:00:00", 1709208000},
+      {"2100-03-01T00:00", 4107542400},
+      {"2023-01-20T15:30:05+02:00", 1674221405},
+      {"2023-01-20T15:30:00-0530", 1674248400},
+      {"2023-01-20T13:30:05.25", 1674221405.25},
+      {"1674221405.5", 1674221405.5},
+  };
+  // days past the end of their month, leap seconds and fields out of range
+  const char *invalid[] = {
+      "2023-02-31",          "2023-02-29",          "2100-02-29",
+      "2023-04-31",          "2023-01-32",          "2023-01-00",
+      "2023-13-01",          "2023-00-10",          "2023-01-20T24:00",
+      "2023-01-20T12:60",    "2016-12-31T23:59:60", "2023-01-20T12:00:61",
+      "2023-01-20T12:00:00x",
+  };
+  char name[96];
+  double epoch;
+
+  for (unsigned int i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+    snprintf(name, sizeof(name), "%s is %.2f", known[i].field, known[i].epoch);
+    scene_expect(name, parse_timestamp(known[i].field, &epoch) &&
+                           epoch == known[i].epoch);
+  }
+
+  for (unsigned int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    snprintf(name, sizeof(name), "%s is not a timestamp", invalid[i]);
+    scene_expect(name, !parse_timestamp(invalid[i], &epoch));
+  }
+
+  // a file of a few chunks, every epoch written by the C library
+  unsigned int height = 60000;
+  double *expected = (double *)malloc(sizeof(double[WIDTH]) * height);
+  FILE *file = fopen(CSV_PATH, "w");
+
+  scene_rng = 3 * 2654435761u + 88172645463325252ull;
+  fprintf(file, "id,lat,lon,alt,time\n");
+
+  for (unsigned int i = 0; i < height; i++) {
+    // from 1901 to 2099, on a quarter of a second
+    time_t seconds = (time_t)(-2.1e9 + scene_uniform() * 6.2e9);
+    double quarter = floor(scene_uniform() * 4) / 4;
+    double *point = expected + (size_t)i * WIDTH;
+    struct tm date;
+    char timestamp[32];
+
+    gmtime_r(&seconds, &date);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &date);
+    point[LAT] = 32 + scene_uniform();
+    point[LON] = 34 + scene_uniform();
+    point[ALT] = scene_uniform() * 3000;
+    point[EPOCH] = (double)seconds + quarter;
+    fprintf(file, "%u,%.17g,%.17g,%.17g,%s.%02d\n", i, point[LAT], point[LON],
+            point[ALT], timestamp, (int)(quarter * 100));
+  }
+
+  fclose(file);
+
+  int error;
+  csv_reader_t *reader =
+      csv_reader_open(CSV_PATH, "lat", "lon", "alt", "time", 4, &error);
+
+  scene_expect("the file is opened", reader != NULL);
+  scene_expect("every record is counted", csv_reader_rows(reader) == height);
+
+  double *data = (double *)malloc(sizeof(double[WIDTH]) * height);
+  unsigned int differ = 0;
+
+  scene_expect("the file is read",
+               csv_reader_read(reader, data, WIDTH, 1, FALSE) == CSV_LOADER_OK);
+
+  for (unsigned int i = 0; i < (size_t)height * WIDTH; i++) {
+    differ += data[i] != expected[i];
+  }
+
+  snprintf(name, sizeof(name), "%u of %u values differ", differ,
+           height * WIDTH);
+  scene_expect(name, differ == 0);
+  csv_reader_close(reader);
+
+  // a day past the end of its month stops the read at its line
+  file = fopen(CSV_PATH, "w");
+  fprintf(file, "lat,lon,alt,time\n"
+                "32,34,100,2023-02-28T23:59:59\n"
+                "32,34,100,2023-02-29T00:00:00\n");
+  fclose(file);
+
+  reader = csv_reader_open(CSV_PATH, "lat", "lon", "alt", "time", 1, &error);
+  scene_expect("a bad date is reported",
+               csv_reader_read(reader, data, WIDTH, 1, FALSE) ==
+                       CSV_LOADER_FORMAT &&
+                   csv_reader_error_line(reader) == 3);
+  csv_reader_close(reader);
+  remove(CSV_PATH);
+
+  free(data);
+  free(expected);
+
+  return scene_report("test_csv_loader");
+}
@@ -0,0 +1,212 @@
+#include "fragment_merge.h"
+#include "reorder_buffer.h"
+#include "scene.h"
+
+// the merged ids of a pass are unions of its ids in order of first appearance
+static void check_merged(const char *name, int *before, int *after,
+                         unsigned int height, unsigned int merges) {
+  int clusters = 0;
+  int merged = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    clusters = before[i] + 1 > clusters ? before[i] + 1 : clusters;
+  }
+
+  int *label = (int *)malloc(sizeof(int) * (clusters + 1));
+  uint8_t consistent = TRUE;
+
+  for (int i = 0; i < clusters; i++) {
+    label[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    if (before[i] == -1 || after[i] == -1) {
+      consistent &= before[i] == after[i];
+      continue;
+    }
+
+    if (label[before[i]] == -1) {
+      // a new merged id is the next one, or the id of an earlier fragment
+      consistent &= after[i] <= merged;
+      merged += after[i] == merged;
+      label[before[i]] = after[i];
+    }
+
+    consistent &= label[before[i]] == after[i];
+  }
+
+  char check[96];
+
+  snprintf(check, sizeof(check), "%s keeps the -1 labels and joins whole ids",
+           name);
+  scene_expect(check, consistent);
+  snprintf(check, sizeof(check), "%s counts every merge", name);
+  scene_expect(check, clusters - merged == (int)merges);
+
+  free(label);
+}
+
+// no merged cluster spans two projectiles, and the clusters either side of
+// the dropout of every projectile are joined
+static void check_tracks(int *after, int *tracks, double *data,
+                         unsigned int height, unsigned int track_count) {
+  int *track_of = (int *)malloc(sizeof(int) * height);
+  int *last = (int *)malloc(sizeof(int) * track_count);
+  uint8_t pure = TRUE;
+  unsigned int joined = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    track_of[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < track_count; i++) {
+    last[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    int track = tracks[i];
+
+    if (track_of[after[i]] == -1) {
+      track_of[after[i]] = track;
+    }
+
+    pure &= track_of[after[i]] == track;
+
+    // the plots of a projectile are at most 1.2 seconds apart outside its
+    // dropout
+    if (last[track] != -1 && data[(size_t)i * WIDTH + EPOCH] -
+                                     data[(size_t)last[track] * WIDTH +
+                                          EPOCH] >
+                                 4) {
+      joined += after[i] == after[last[track]];
+    }
+
+    last[track] = (int)i;
+  }
+
+  scene_expect("no merged cluster spans two projectiles", pure);
+  scene_expect("the clusters either side of every dropout are joined",
+               joined == track_count);
+
+  free(last);
+  free(track_of);
+}
+
+// give the ids of points in another order by first appearance in that order
+static void relabel(int *labels, unsigned int height) {
+  int *names = (int *)malloc(sizeof(int) * height);
+  int next_name = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    names[i] = -1;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    if (labels[i] == -1) {
+      continue;
+    }
+
+    if (names[labels[i]] == -1) {
+      names[labels[i]] = next_name++;
+    }
+
+    labels[i] = names[labels[i]];
+  }
+
+  free(names);
+}
+
+int main(void) {
+  // every track misses 8 seconds of plots, more than `time_threshold`
+  scene_params_t scene = {30, 600, 120, 20000, 10, 8, 0, 7};
+  unsigned int height;
+  int *tracks;
+  double *data = scene_generate(&scene, &height, &tracks);
+  int *before = (int *)malloc(sizeof(int) * height);
+  int *after = (int *)malloc(sizeof(int) * height);
+  int *sorted = (int *)malloc(sizeof(int) * height);
+
+  // the fastest projectiles fly 660 meters between two plots
+  agglomerative_clustering_strided(NULL, data, height, WIDTH, 1, 800, 5, 20,
+                                   100, 4, before);
+  memcpy(after, before, sizeof(int) * height);
+
+  unsigned int merges = merge_fragments(data, height, WIDTH, 1, 800, 20, 100,
+                                        4, 15, after);
+
+  check_merged("sorted pass", before, after, height, merges);
+  check_tracks(after, tracks, data, height, scene.tracks);
+  memcpy(sorted, after, sizeof(int) * height);
+
+  // points swapped within `lateness` are all clustered, and merge like the
+  // same points in epoch order
+  double *arrivals = (double *)malloc(sizeof(double[WIDTH]) * height);
+  unsigned int *arrival_of =
+      (unsigned int *)malloc(sizeof(unsigned int) * height);
+
+  for (unsigned int i = 0; i < height; i++) {
+    arrival_of[i] = i;
+  }
+
+  for (unsigned int i = 0; i + 3 < height; i += 4) {
+    arrival_of[i] = i + 3;
+    arrival_of[i + 3] = i;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    memcpy(arrivals + (size_t)i * WIDTH, data + (size_t)arrival_of[i] * WIDTH,
+           sizeof(double[WIDTH]));
+  }
+
+  unsigned int late = agglomerative_clustering_unordered(
+      NULL, arrivals, height, WIDTH, 1, 30, 800, 5, 20, 100, 4, before);
+
+  memcpy(after, before, sizeof(int) * height);
+  merges = merge_fragments(arrivals, height, WIDTH, 1, 800, 20, 100, 4, 15,
+                           after);
+
+  scene_expect("the swapped points are not late", late == 0);
+  check_merged("pass with swapped points", before, after, height, merges);
+
+  int *by_epoch = (int *)malloc(sizeof(int) * height);
+
+  for (unsigned int i = 0; i < height; i++) {
+    by_epoch[arrival_of[i]] = after[i];
+  }
+
+  relabel(by_epoch, height);
+  scene_compare("merge of swapped points", sorted, by_epoch, height);
+
+  // a point more than `lateness` behind the newest point gets -1
+  memcpy(arrivals, data, sizeof(double[WIDTH]) * height);
+
+  for (unsigned int i = 50; i < height; i += 50) {
+    double held[WIDTH];
+
+    memcpy(held, arrivals + (size_t)(i - 50) * WIDTH, sizeof(held));
+    memmove(arrivals + (size_t)(i - 50) * WIDTH,
+            arrivals + (size_t)(i - 49) * WIDTH,
+            sizeof(double[WIDTH]) * 49);
+    memcpy(arrivals + (size_t)(i - 1) * WIDTH, held, sizeof(held));
+  }
+
+  late = agglomerative_clustering_unordered(NULL, arrivals, height, WIDTH, 1,
+                                            1, 800, 5, 20, 100, 4, before);
+  memcpy(after, before, sizeof(int) * height);
+  merges = merge_fragments(arrivals, height, WIDTH, 1, 800, 20, 100, 4, 15,
+                           after);
+
+  scene_expect("the delayed points are late", late > 0);
+  check_merged("pass with late points", before, after, height, merges);
+
+  free(by_epoch);
+  free(arrival_of);
+  free(arrivals);
+  free(sorted);
+  free(after);
+  free(before);
+  free(tracks);
+  free(data);
+
+  return scene_report("test_fragment_merge");
+}
@@ -0,0 +1,138 @@
+#include "reorder_buffer.h"
+#include "scene.h"
+
+typedef struct arrival_s {
+  double time;
+  unsigned int point;
+} arrival_t;
+
+static int compare_arrivals(const void *first, const void *second) {
+  const arrival_t *first_arrival = (const arrival_t *)first;
+  const arrival_t *second_arrival = (const arrival_t *)second;
+
+  if (first_arrival->time != second_arrival->time) {
+    return first_arrival->time < second_arrival->time ? -1 : 1;
+  }
+
+  return (first_arrival->point > second_arrival->point) -
+         (first_arrival->point < second_arrival->point);
+}
+
+static double *sorted_data;
+
+static int compare_released(const void *first, const void *second) {
+  unsigned int first_index = *(const unsigned int *)first;
+  unsigned int second_index = *(const unsigned int *)second;
+  double first_epoch = sorted_data[(size_t)first_index * WIDTH + EPOCH];
+  double second_epoch = sorted_data[(size_t)second_index * WIDTH + EPOCH];
+
+  if (first_epoch != second_epoch) {
+    return first_epoch < second_epoch ? -1 : 1;
+  }
+
+  return (first_index > second_index) - (first_index < second_index);
+}
+
+/// @brief cluster the points of a scene in an order where every point is
+/// delayed by up to `delay` seconds and check the labels against a single pass
+/// over the points that were not late, in epoch order
+static void check_delayed(double *data, unsigned int height, double delay,
+                          double lateness, uint8_t expect_late) {
+  arrival_t *arrivals = (arrival_t *)malloc(sizeof(arrival_t) * height);
+  double *arrived = (double *)malloc(sizeof(double[WIDTH]) * height);
+  int *labels = (int *)malloc(sizeof(int) * height);
+  unsigned int *released =
+      (unsigned int *)malloc(sizeof(unsigned int) * height);
+  double *points = (double *)malloc(sizeof(double[WIDTH]) * height);
+  int *expected = (int *)malloc(sizeof(int) * height);
+  int *single = (int *)malloc(sizeof(int) * height);
+  unsigned int released_len = 0;
+  unsigned int late = 0;
+  double newest = -INFINITY;
+  char name[96];
+
+  for (unsigned int i = 0; i < height; i++) {
+    arrivals[i].time =
+        data[(size_t)i * WIDTH + EPOCH] + scene_uniform() * delay;
+    arrivals[i].point = i;
+  }
+
+  qsort(arrivals, height, sizeof(arrival_t), compare_arrivals);
+
+  // a point older than the watermark of the points before it is late
+  for (unsigned int i = 0; i < height; i++) {
+    double *point = data + (size_t)arrivals[i].point * WIDTH;
+
+    memcpy(arrived + (size_t)i * WIDTH, point, sizeof(double[WIDTH]));
+
+    if (point[EPOCH] < newest - lateness) {
+      expected[i] = -1;
+      late++;
+      continue;
+    }
+
+    newest = fmax(newest, point[EPOCH]);
+    released[released_len++] = i;
+  }
+
+  // the buffer releases in epoch order, ties in arrival order
+  sorted_data = arrived;
+  qsort(released, released_len, sizeof(unsigned int), compare_released);
+
+  for (unsigned int i = 0; i < released_len; i++) {
+    memcpy(points + (size_t)i * WIDTH, arrived + (size_t)released[i] * WIDTH,
+           sizeof(double[WIDTH]));
+  }
+
+  agglomerative_clustering_strided(NULL, points, released_len, WIDTH, 1, 300,
+                                   5, 20, 100, 4, single);
+
+  for (unsigned int i = 0; i < released_len; i++) {
+    expected[released[i]] = single[i];
+  }
+
+  unsigned int counted = agglomerative_clustering_unordered(
+      NULL, arrived, height, WIDTH, 1, lateness, 300, 5, 20, 100, 4, labels);
+
+  snprintf(name, sizeof(name), "delay %g lateness %g", delay, lateness);
+  scene_compare(name, expected, labels, height);
+  snprintf(name, sizeof(name), "delay %g lateness %g late count", delay,
+           lateness);
+  scene_expect(name, counted == late && (late > 0) == expect_late);
+
+  free(single);
+  free(expected);
+  free(points);
+  free(released);
+  free(labels);
+  free(arrived);
+  free(arrivals);
+}
+
+int main(void) {
+  scene_params_t scene = {60, 600, 120, 20000, 10, 0, 0, 5};
+  unsigned int height;
+  double *data = scene_generate(&scene, &height, NULL);
+  int *expected = (int *)malloc(sizeof(int) * height);
+  int *labels = (int *)malloc(sizeof(int) * height);
+
+  // sorted points are clustered like a single pass
+  agglomerative_clustering_strided(NULL, data, height, WIDTH, 1, 300, 5, 20,
+                                   100, 4, expected);
+  scene_expect("sorted points are not late",
+               agglomerative_clustering_unordered(NULL, data, height, WIDTH,
+                                                  1, 2, 300, 5, 20, 100, 4,
+                                                  labels) == 0);
+  scene_compare("sorted points", expected, labels, height);
+
+  // points delayed less than the lateness are put back in order
+  check_delayed(data, height, 2, 2, FALSE);
+  // and the ones delayed more are late
+  check_delayed(data, height, 6, 2, TRUE);
+
+  free(labels);
+  free(expected);
+  free(data);
+
+  return scene_report("test_reorder_buffer");
+}
@@ -0,0 +1,78 @@
+#include "scan_batch.h"
+#include "scene.h"
+
+int main(void) {
+  scene_params_t scene = {60, 600, 120, 20000, 10, 0, 0, 13};
+  unsigned int height;
+  double *data = scene_generate(&scene, &height, NULL);
+  int *expected = (int *)malloc(sizeof(int) * height);
+  int *labels = (int *)malloc(sizeof(int) * height);
+
+  // with distinct epochs every scan is one point, clustered like a single
+  // pass
+  agglomerative_clustering_strided(NULL, data, height, WIDTH, 1, 300, 5, 20,
+                                   100, 4, expected);
+  agglomerative_clustering_scans(NULL, data, height, WIDTH, 1, 300, 5, 20, 100,
+                                 4, labels);
+  scene_compare("scans of one point", expected, labels, height);
+  free(data);
+
+  // every plot of a one second scan shares its epoch
+  scene.scan = 1;
+  data = scene_generate(&scene, &height, NULL);
+  expected = (int *)realloc(expected, sizeof(int) * height);
+  labels = (int *)realloc(labels, sizeof(int) * height);
+
+  agglomerative_clustering_scans(NULL, data, height, WIDTH, 1, 300, 5, 20, 100,
+                                 4, expected);
+
+  int clusters = 0;
+
+  for (unsigned int i = 0; i < height; i++) {
+    clusters = expected[i] + 1 > clusters ? expected[i] + 1 : clusters;
+  }
+
+  // the last epoch every cluster took a point at
+  double *taken = (double *)malloc(sizeof(double) * clusters);
+  uint8_t one_per_scan = TRUE;
+
+  for (int i = 0; i < clusters; i++) {
+    taken[i] = -INFINITY;
+  }
+
+  for (unsigned int i = 0; i < height; i++) {
+    double epoch = data[(size_t)i * WIDTH + EPOCH];
+
+    one_per_scan &= taken[expected[i]] != epoch;
+    taken[expected[i]] = epoch;
+  }
+
+  scene_expect("a cluster takes one point of a scan at most", one_per_scan);
+
+  // a stream pushed in chunks that end between scans is clustered alike
+  clustering_state_t *state = clustering_init(300, 5, 20, 100, 4);
+  unsigned int start = 0;
+
+  while (start < height) {
+    unsigned int end = start + 500 < height ? start + 500 : height;
+
+    while (end < height && data[(size_t)end * WIDTH + EPOCH] ==
+                               data[(size_t)(end - 1) * WIDTH + EPOCH]) {
+      end++;
+    }
+
+    clustering_push_scans(state, data + (size_t)start * WIDTH, end - start,
+                          WIDTH, 1, labels + start);
+    start = end;
+  }
+
+  clustering_destroy(state);
+  scene_compare("scans pushed in chunks", expected, labels, height);
+
+  free(taken);
+  free(labels);
+  free(expected);
+  free(data);
+
+  return scene_report("test_scan_batch");
+}
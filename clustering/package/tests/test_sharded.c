@@ -0,0 +1,66 @@
+#include "scene.h"
+
+// the shards are stitched so the labels are the ones of a single pass
+int main(void) {
+  clustering_params_t params[] = {
+      {800, 3, 30, 100, 4},
+      {300, 10, 20, INFINITY, 10},
+      {2000, 5, 45, 200, 1},
+      // the clusters of the earlier shards stay open, so the shards are
+      // replayed whole
+      {2000, INFINITY, 45, 200, 4},
+  };
+  scene_params_t scene = {40, 600, 120, 20000, 10, 0, 0, 0};
+  char name[64];
+
+  for (unsigned int seed = 1; seed <= 4; seed++) {
+    for (unsigned int p = 0; p < sizeof(params) / sizeof(params[0]); p++) {
+      clustering_params_t *param = &params[p];
+      unsigned int height;
+      double *data;
+
+      scene.seed = seed;
+      data = scene_generate(&scene, &height, NULL);
+      int *expected = (int *)malloc(sizeof(int) * height);
+      int *labels = (int *)malloc(sizeof(int) * height);
+
+      agglomerative_clustering_strided(
+          NULL, data, height, WIDTH, 1, param->distance_threshold,
+          param->time_threshold, param->angle_diff_threshold,
+          param->speed_diff_threshold, param->window_size, expected);
+
+      for (unsigned int shards = 2; shards <= 16; shards++) {
+        agglomerative_clustering_sharded(
+            data, height, WIDTH, 1, shards, param->distance_threshold,
+            param->time_threshold, param->angle_diff_threshold,
+            param->speed_diff_threshold, param->window_size, labels);
+        snprintf(name, sizeof(name), "seed %u params %u shards %u", seed, p,
+                 shards);
+        scene_compare(name, expected, labels, height);
+      }
+
+      // the column major layout of NumPy
+      double *columns = (double *)malloc(sizeof(double[WIDTH]) * height);
+
+      for (unsigned int i = 0; i < height; i++) {
+        for (unsigned int j = 0; j < WIDTH; j++) {
+          columns[(size_t)j * height + i] = data[(size_t)i * WIDTH + j];
+        }
+      }
+
+      agglomerative_clustering_sharded(
+          columns, height, 1, height, 7, param->distance_threshold,
+          param->time_threshold, param->angle_diff_threshold,
+          param->speed_diff_threshold, param->window_size, labels);
+      snprintf(name, sizeof(name), "seed %u params %u column major", seed, p);
+      scene_compare(name, expected, labels, height);
+
+      free(columns);
+      free(labels);
+      free(expected);
+      free(data);
+    }
+  }
+
+  return scene_report("test_sharded");
+}
@@ -0,0 +1,89 @@
+#include "scene.h"
+#include "spatial_tiles.h"
+
+// the tiles that interact are clustered together so the labels are the ones
+// of a single pass, whatever the tracks crossing the borders
+int main(void) {
+  clustering_params_t params[] = {
+      {800, 3, 30, 100, 4},
+      {300, 10, 20, INFINITY, 10},
+      // every point of a tile can reach its neighbors at any time
+      {2000, INFINITY, 30, 100, 4},
+  };
+  double tile_sizes[] = {2000, 5000, 20000};
+  // the projectiles fly up to 66 km, across many tiles
+  scene_params_t scene = {60, 600, 120, 20000, 10, 0, 0, 0};
+  char name[80];
+
+  for (unsigned int seed = 1; seed <= 4; seed++) {
+    unsigned int height;
+    double *data;
+
+    scene.seed = seed;
+    data = scene_generate(&scene, &height, NULL);
+    int *expected = (int *)malloc(sizeof(int) * height);
+    int *labels = (int *)malloc(sizeof(int) * height);
+
+    for (unsigned int p = 0; p < sizeof(params) / sizeof(params[0]); p++) {
+      clustering_params_t *param = &params[p];
+
+      agglomerative_clustering_strided(
+          NULL, data, height, WIDTH, 1, param->distance_threshold,
+          param->time_threshold, param->angle_diff_threshold,
+          param->speed_diff_threshold, param->window_size, expected);
+
+      for (unsigned int t = 0; t < sizeof(tile_sizes) / sizeof(double); t++) {
+        for (int threads = 1; threads <= 4; threads += 3) {
+          agglomerative_clustering_tiled(
+              data, height, WIDTH, 1, tile_sizes[t],
+              param->distance_threshold, param->time_threshold,
+              param->angle_diff_threshold, param->speed_diff_threshold,
+              param->window_size, threads, labels);
+          snprintf(name, sizeof(name), "seed %u params %u tile %g threads %d",
+                   seed, p, tile_sizes[t], threads);
+          scene_compare(name, expected, labels, height);
+        }
+      }
+    }
+
+    free(labels);
+    free(expected);
+    free(data);
+  }
+
+  // tracks far apart in space or time leave the tiles in separate groups
+  scene_params_t sparse = {20, 6000, 60, 200000, 10, 0, 0, 9};
+  unsigned int height;
+  double *data = scene_generate(&sparse, &height, NULL);
+  int *expected = (int *)malloc(sizeof(int) * height);
+  int *labels = (int *)malloc(sizeof(int) * height);
+  tile_plan_t plan;
+  spatial_grid_t grid;
+
+  memset(&grid, 0, sizeof(spatial_grid_t));
+  tile_plan_build(&plan, data, height, WIDTH, 1, 2000, 300);
+
+  uint32_t *links = (uint32_t *)malloc(sizeof(uint32_t) * plan.tiles);
+
+  for (unsigned int i = 0; i < plan.tiles; i++) {
+    links[i] = link_tile(&grid, &plan, i, data, WIDTH, 1, 300, 5);
+  }
+
+  group_tiles(&plan, links);
+  scene_expect("separate tracks are clustered apart", plan.groups > 1);
+
+  agglomerative_clustering_strided(NULL, data, height, WIDTH, 1, 300, 5, 20,
+                                   100, 4, expected);
+  agglomerative_clustering_tiled(data, height, WIDTH, 1, 2000, 300, 5, 20, 100,
+                                 4, 4, labels);
+  scene_compare("separate tracks", expected, labels, height);
+
+  spatial_grid_free(&grid);
+  tile_plan_free(&plan);
+  free(links);
+  free(labels);
+  free(expected);
+  free(data);
+
+  return scene_report("test_spatial_tiles");
+}
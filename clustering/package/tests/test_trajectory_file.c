@@ -0,0 +1,89 @@
+#include "scene.h"
+#include "trajectory_file.h"
+
+#define POINTS_PATH "test_trajectory_file.tbag"
+#define LABELS_PATH "test_trajectory_file.labels"
+
+// reads the labels file of a run, a bare column of ints
+static uint8_t read_labels(int *labels, unsigned int height) {
+  FILE *file = fopen(LABELS_PATH, "rb");
+
+  if (file == NULL) {
+    return FALSE;
+  }
+
+  size_t read = fread(labels, sizeof(int), height, file);
+
+  fclose(file);
+  return read == height;
+}
+
+// the mapped run streams the points through one state like a single pass
+int main(void) {
+  scene_params_t scene = {60, 600, 120, 20000, 10, 0, 0, 11};
+  unsigned int height;
+  double *data = scene_generate(&scene, &height, NULL);
+  int *expected = (int *)malloc(sizeof(int) * height);
+  int *labels = (int *)malloc(sizeof(int) * height);
+
+  agglomerative_clustering_strided(NULL, data, height, WIDTH, 1, 300, 5, 20,
+                                   100, 4, expected);
+
+  scene_expect("the points are written",
+               trajectory_file_write(POINTS_PATH, data, height, WIDTH, 1) ==
+                   TRAJECTORY_FILE_OK);
+  scene_expect("the file is clustered",
+               agglomerative_clustering_file(POINTS_PATH, LABELS_PATH, 300, 5,
+                                             20, 100, 4, 1) ==
+                   TRAJECTORY_FILE_OK);
+  scene_expect("the labels are read", read_labels(labels, height));
+  scene_compare("mapped run", expected, labels, height);
+
+  // the column major layout of NumPy gives the same file
+  double *columns = (double *)malloc(sizeof(double[WIDTH]) * height);
+
+  for (unsigned int i = 0; i < height; i++) {
+    for (unsigned int j = 0; j < WIDTH; j++) {
+      columns[(size_t)j * height + i] = data[(size_t)i * WIDTH + j];
+    }
+  }
+
+  trajectory_file_write(POINTS_PATH, columns, height, 1, height);
+  agglomerative_clustering_file(POINTS_PATH, LABELS_PATH, 300, 5, 20, 100, 4,
+                                2);
+  read_labels(labels, height);
+  scene_compare("mapped run of a column major write", expected, labels,
+                height);
+
+  // a point older than the one before it stops the run
+  data[(size_t)(height / 2) * WIDTH + EPOCH] -= 1000;
+  trajectory_file_write(POINTS_PATH, data, height, WIDTH, 1);
+  scene_expect("unsorted epochs are reported",
+               agglomerative_clustering_file(POINTS_PATH, LABELS_PATH, 300, 5,
+                                             20, 100, 4, 1) ==
+                   TRAJECTORY_FILE_UNSORTED);
+
+  FILE *file = fopen(POINTS_PATH, "r+b");
+
+  fwrite("NOTATBAG", 1, 8, file);
+  fclose(file);
+  scene_expect("a bad header is reported",
+               agglomerative_clustering_file(POINTS_PATH, LABELS_PATH, 300, 5,
+                                             20, 100, 4, 1) ==
+                   TRAJECTORY_FILE_FORMAT);
+
+  remove(POINTS_PATH);
+  remove(LABELS_PATH);
+  scene_expect("a missing file is reported",
+               agglomerative_clustering_file(POINTS_PATH, LABELS_PATH, 300, 5,
+                                             20, 100, 4, 1) ==
+                   TRAJECTORY_FILE_IO);
+  remove(LABELS_PATH);
+
+  free(columns);
+  free(labels);
+  free(expected);
+  free(data);
+
+  return scene_report("test_trajectory_file");
+}